@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+
+namespace sshash {
+
+/* A blocking FIFO queue of bounded capacity, used to connect the stages of
+   producer-consumer pipelines. */
+template <typename T>
+struct bounded_queue {
+    bounded_queue(uint64_t capacity) : m_capacity(capacity), m_closed(false) {
+        assert(capacity > 0);
+    }
+
+    /* Wait until there is room for val. */
+    void push(T val) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [&] { return m_queue.size() < m_capacity; });
+        m_queue.push(std::move(val));
+        m_not_empty.notify_one();
+    }
+
+    /* Wait until an element is available and return true, or
+       return false if the queue is closed and empty. */
+    bool pop(T& val) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [&] { return !m_queue.empty() or m_closed; });
+        if (m_queue.empty()) return false;
+        val = std::move(m_queue.front());
+        m_queue.pop();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    /* No more elements will be pushed: wake up all waiting consumers. */
+    void close() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_empty.notify_all();
+    }
+
+private:
+    uint64_t m_capacity;
+    bool m_closed;
+    std::queue<T> m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+};
+
+}  // namespace sshash
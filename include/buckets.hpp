@@ -3,10 +3,17 @@
 #include "util.hpp"
 #include "bit_vector_iterator.hpp"
 #include "ef_sequence.hpp"
+#include "ranked_bit_vector.hpp"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace sshash {
 
 struct buckets {
+    buckets() : locality_base(0), locality_num_super_kmers(0) {}
+
     std::pair<lookup_result, uint64_t> offset_to_id(uint64_t offset, uint64_t k) const {
         auto [pos, contig_begin, contig_end] = pieces.locate(offset);
 
@@ -63,12 +70,44 @@ struct buckets {
     }
 
     std::pair<uint64_t, uint64_t> locate_bucket(uint64_t bucket_id) const {
+        if (locality_base != 0) {
+            uint64_t slot = offsets.access(bucket_id);
+            if (slot < locality_base) return {bucket_id, bucket_id + 1};  // singleton bucket
+            uint64_t header = slot - locality_base;
+            return {header + 1, header + 1 + offsets.access(header)};
+        }
+        if (singleton_split()) {
+            auto [singleton, rank] = singleton_buckets.access_and_rank(bucket_id);
+            if (singleton) return {rank, rank + 1};
+            uint64_t i = bucket_id - rank;  // among the non-singleton buckets
+            uint64_t base = singleton_buckets.num_ones();
+            uint64_t begin = base + num_super_kmers_before_bucket.access(i) + i;
+            uint64_t end = base + num_super_kmers_before_bucket.access(i + 1) + i + 1;
+            assert(begin + 1 < end);
+            return {begin, end};
+        }
         uint64_t begin = num_super_kmers_before_bucket.access(bucket_id) + bucket_id;
         uint64_t end = num_super_kmers_before_bucket.access(bucket_id + 1) + bucket_id + 1;
         assert(begin < end);
         return {begin, end};
     }
 
+    /* Prefetching hooks used by the batched lookup. */
+    void prefetch_bucket(uint64_t bucket_id) const {
+        if (locality_base != 0) return prefetch_offset(bucket_id);
+        if (singleton_split()) return singleton_buckets.prefetch(bucket_id);
+        num_super_kmers_before_bucket.prefetch(bucket_id);
+        num_super_kmers_before_bucket.prefetch(bucket_id + 1);
+    }
+    void prefetch_offset(uint64_t super_kmer_id) const {
+        __builtin_prefetch(offsets.bits().data() + ((super_kmer_id * offsets.width()) >> 6));
+    }
+    void prefetch_string(uint64_t offset) const {
+        uint64_t const* ptr = strings.data().data() + ((2 * offset) >> 6);
+        __builtin_prefetch(ptr);
+        __builtin_prefetch(ptr + 1);
+    }
+
     lookup_result lookup(uint64_t bucket_id, kmer_t target_kmer, uint64_t k, uint64_t m) const {
         auto [begin, end] = locate_bucket(bucket_id);
         return lookup(begin, end, target_kmer, k, m);
@@ -90,20 +129,43 @@ struct buckets {
                                        uint64_t m) const {
         uint64_t offset = offsets.access(super_kmer_id);
         auto [res, contig_end] = offset_to_id(offset, k);
-        bit_vector_iterator bv_it(strings, 2 * offset);
         uint64_t window_size = std::min<uint64_t>(k - m + 1, contig_end - offset - k + 1);
-        for (uint64_t w = 0; w != window_size; ++w) {
-            kmer_t read_kmer = bv_it.read_and_advance_by_two(2 * k);
-            if (read_kmer == target_kmer) {
-                res.kmer_id += w;
-                res.kmer_id_in_contig += w;
-                assert(is_valid(res));
-                return res;
-            }
+        uint64_t w = scan_window<false>(offset, window_size, target_kmer, 0, k).first;
+        if (w != window_size) {
+            res.kmer_id += w;
+            res.kmer_id_in_contig += w;
+            assert(is_valid(res));
+            return res;
         }
         return lookup_result();
     }
 
+    /*
+        Search target_kmer in the super-k-mers [begin, end) and target_kmer_rc in
+        [begin_rc, end_rc), alternating between the two ranges. A forward match takes
+        precedence over a backward one, as if the two ranges were scanned one after
+        the other.
+    */
+    lookup_result lookup_both_strands(uint64_t begin, uint64_t end, uint64_t begin_rc,
+                                      uint64_t end_rc, kmer_t target_kmer, kmer_t target_kmer_rc,
+                                      uint64_t k, uint64_t m) const {
+        lookup_result res_rc;
+        while (begin != end or begin_rc != end_rc) {
+            if (begin != end) {
+                auto res = lookup_in_super_kmer(begin++, target_kmer, k, m);
+                if (res.kmer_id != constants::invalid_uint64) return res;
+            }
+            if (begin_rc != end_rc) {
+                res_rc = lookup_in_super_kmer(begin_rc++, target_kmer_rc, k, m);
+                if (res_rc.kmer_id != constants::invalid_uint64) {
+                    res_rc.kmer_orientation = constants::backward_orientation;
+                    begin_rc = end_rc;  // keep scanning the forward range only
+                }
+            }
+        }
+        return res_rc;
+    }
+
     lookup_result lookup_canonical(uint64_t bucket_id, kmer_t target_kmer, kmer_t target_kmer_rc,
                                    uint64_t k, uint64_t m) const {
         auto [begin, end] = locate_bucket(bucket_id);
@@ -115,53 +177,28 @@ struct buckets {
         for (uint64_t super_kmer_id = begin; super_kmer_id != end; ++super_kmer_id) {
             uint64_t offset = offsets.access(super_kmer_id);
             auto [res, contig_end] = offset_to_id(offset, k);
-            bit_vector_iterator bv_it(strings, 2 * offset);
             uint64_t window_size = std::min<uint64_t>(k - m + 1, contig_end - offset - k + 1);
-            for (uint64_t w = 0; w != window_size; ++w) {
-                kmer_t read_kmer = bv_it.read_and_advance_by_two(2 * k);
-                if (read_kmer == target_kmer) {
-                    res.kmer_id += w;
-                    res.kmer_id_in_contig += w;
-                    res.kmer_orientation = constants::forward_orientation;
-                    assert(is_valid(res));
-                    return res;
-                }
-                if (read_kmer == target_kmer_rc) {
-                    res.kmer_id += w;
-                    res.kmer_id_in_contig += w;
-                    res.kmer_orientation = constants::backward_orientation;
-                    assert(is_valid(res));
-                    return res;
-                }
+            auto [w, orientation] =
+                scan_window<true>(offset, window_size, target_kmer, target_kmer_rc, k);
+            if (w != window_size) {
+                res.kmer_id += w;
+                res.kmer_id_in_contig += w;
+                res.kmer_orientation = orientation;
+                assert(is_valid(res));
+                return res;
             }
         }
         return lookup_result();
     }
 
+    /* Return the id of the contig containing the k-mer of the given id. */
+    uint64_t id_to_contig(uint64_t id) const {
+        assert(id < num_kmers_before_contig.back());
+        return num_kmers_before_contig.prev_leq(id);
+    }
+
     uint64_t id_to_offset(uint64_t id, uint64_t k) const {
-        constexpr uint64_t linear_scan_threshold = 8;
-        uint64_t lo = 0;
-        uint64_t hi = pieces.size() - 1;
-        assert(pieces.access(0) == 0);
-        while (lo < hi) {
-            if (hi - lo <= linear_scan_threshold) {
-                for (; lo < hi; ++lo) {
-                    uint64_t val = pieces.access(lo) - lo * (k - 1);
-                    if (val > id) break;
-                }
-                break;
-            }
-            uint64_t mid = lo + (hi - lo) / 2;
-            uint64_t val = pieces.access(mid);
-            assert(val >= mid * (k - 1));
-            if (id <= val - mid * (k - 1)) {
-                hi = mid;
-            } else {
-                lo = mid + 1;
-            }
-        }
-        if (lo < pieces.size() and pieces.access(lo) - lo * (k - 1) > id) --lo;
-        return id + lo * (k - 1);
+        return id + id_to_contig(id) * (k - 1);
     }
 
     void access(uint64_t kmer_id, char* string_kmer, uint64_t k) const {
@@ -177,10 +214,9 @@ struct buckets {
         iterator(buckets const* ptr, uint64_t kmer_id, uint64_t k, uint64_t num_kmers)
             : m_buckets(ptr), m_kmer_id(kmer_id), m_k(k), m_num_kmers(num_kmers) {
             bv_it = bit_vector_iterator(m_buckets->strings, -1);
-            offset = m_buckets->id_to_offset(m_kmer_id, k);
-            auto [pos, piece_end] = m_buckets->pieces.next_geq(offset);
-            if (piece_end == offset) pos += 1;
-            pieces_it = m_buckets->pieces.at(pos);
+            uint64_t contig_id = m_buckets->id_to_contig(m_kmer_id);
+            offset = m_kmer_id + contig_id * (k - 1);
+            pieces_it = m_buckets->pieces.at(contig_id + 1);
             next_piece();
             ret.second.resize(k, 0);
         }
@@ -239,25 +275,397 @@ struct buckets {
         return iterator(this, kmer_id, k, size);
     }
 
+    /* As iterator, but the k-mers are returned in 2-bit encoding, without building strings. */
+    struct uint_iterator {
+        uint_iterator() {}
+
+        uint_iterator(buckets const* ptr, uint64_t kmer_id, uint64_t k, uint64_t num_kmers)
+            : m_buckets(ptr), m_kmer_id(kmer_id), m_k(k), m_num_kmers(num_kmers) {
+            bv_it = bit_vector_iterator(m_buckets->strings, -1);
+            if (!has_next()) return;
+            uint64_t contig_id = m_buckets->id_to_contig(m_kmer_id);
+            offset = m_kmer_id + contig_id * (k - 1);
+            pieces_it = m_buckets->pieces.at(contig_id + 1);
+            next_piece();
+        }
+
+        bool has_next() const { return m_kmer_id != m_num_kmers; }
+
+        std::pair<uint64_t, kmer_t> next() {
+            assert(has_next());
+            if (offset == next_offset - m_k + 1) {
+                offset = next_offset;
+                next_piece();
+            }
+            std::pair<uint64_t, kmer_t> ret = {m_kmer_id, read_kmer};
+            ++m_kmer_id;
+            ++offset;
+            if (offset != next_offset - m_k + 1) {
+                read_kmer >>= 2;
+                read_kmer += bv_it.get_next_two_bits() << (2 * (m_k - 1));
+            }
+            return ret;
+        }
+
+    private:
+        buckets const* m_buckets;
+        uint64_t m_kmer_id, m_k, m_num_kmers;
+        uint64_t offset;
+        uint64_t next_offset;
+        bit_vector_iterator bv_it;
+        ef_sequence<true>::iterator pieces_it;
+        kmer_t read_kmer;
+
+        void next_piece() {
+            bv_it.at(2 * offset);
+            next_offset = pieces_it.next();
+            assert(next_offset >= offset + m_k);
+            read_kmer = bv_it.take(2 * m_k);
+        }
+    };
+
+    uint_iterator at_uint(uint64_t kmer_id, uint64_t k, uint64_t size) const {
+        return uint_iterator(this, kmer_id, k, size);
+    }
+
+    /* Iterate over the contigs, as spans of the 2-bit encoded strings. */
+    struct contig_iterator {
+        contig_iterator() {}
+
+        contig_iterator(buckets const* ptr, uint64_t contig_id, uint64_t k)
+            : m_contig_id(contig_id), m_num_contigs(ptr->pieces.size() - 1), m_k(k) {
+            if (!has_next()) return;
+            pieces_it = ptr->pieces.at(contig_id);
+            m_begin = pieces_it.next();
+        }
+
+        bool has_next() const { return m_contig_id != m_num_contigs; }
+
+        contig_span next() {
+            assert(has_next());
+            uint64_t end = pieces_it.next();
+            contig_span span;
+            span.contig_id = m_contig_id;
+            span.kmer_id = m_begin - m_contig_id * (m_k - 1);
+            span.begin = m_begin;
+            span.end = end;
+            ++m_contig_id;
+            m_begin = end;
+            return span;
+        }
+
+    private:
+        uint64_t m_contig_id, m_num_contigs, m_k;
+        uint64_t m_begin;
+        ef_sequence<true>::iterator pieces_it;
+    };
+
+    contig_iterator contig_at(uint64_t contig_id, uint64_t k) const {
+        return contig_iterator(this, contig_id, k);
+    }
+
+    /*
+        Call f(kmer_id, uint_kmer) for every k-mer of the contigs in [contig_begin, contig_end),
+        in order of kmer_id. Each k-mer is obtained from the previous one with a shift.
+    */
+    template <typename Func>
+    void for_each_kmer(uint64_t contig_begin, uint64_t contig_end, uint64_t k, Func f) const {
+        assert(contig_begin <= contig_end and contig_end < pieces.size());
+        if (contig_begin == contig_end) return;
+        auto pieces_it = pieces.at(contig_begin);
+        uint64_t begin = pieces_it.next();
+        uint64_t kmer_id = begin - contig_begin * (k - 1);
+        bit_vector_iterator bv_it(strings, 2 * begin);
+        for (uint64_t contig_id = contig_begin; contig_id != contig_end; ++contig_id) {
+            uint64_t end = pieces_it.next();
+            assert(end >= begin + k);
+            bv_it.at(2 * begin);
+            kmer_t uint_kmer = bv_it.take(2 * k);
+            f(kmer_id++, uint_kmer);
+            for (uint64_t offset = begin + k; offset != end; ++offset) {
+                uint_kmer >>= 2;
+                uint_kmer += bv_it.get_next_two_bits() << (2 * (k - 1));
+                f(kmer_id++, uint_kmer);
+            }
+            begin = end;
+        }
+    }
+
+    bool locality_layout() const { return locality_base != 0; }
+
+    uint64_t num_super_kmers() const {
+        return locality_layout() ? locality_num_super_kmers : offsets.size();
+    }
+
+    /*
+        Switch to the locality layout, in which offsets begins with one slot per bucket.
+        The slot of a singleton bucket is the offset of its super-k-mer, so that locating
+        the bucket costs no extra memory access. The slot of any other bucket is
+        locality_base + p, where offsets[p] is the size of the bucket and its offsets
+        follow at positions p + 1, p + 2, etc. This replaces num_super_kmers_before_bucket.
+        A record that would straddle two cache lines is moved to the beginning of the next
+        line (of the array, which the tools allocate cache-line-aligned: see
+        huge_pages_allocate) if it fits there, so that reading the header and the offsets
+        of a small bucket touches a single line.
+    */
+    void build_locality_layout(uint64_t num_buckets) {
+        assert(!locality_layout());
+        uint64_t num_super_kmers = offsets.size();
+        uint64_t base = strings.size() / 2;  // larger than any offset
+        assert(base > 0);
+
+        /* Return the position of a record of the given size starting at pos or after. */
+        auto record_position = [](uint64_t pos, uint64_t size, uint64_t width) {
+            constexpr uint64_t line = 8 * constants::cache_line_size;  // in bits
+            uint64_t begin = pos * width;
+            uint64_t end = begin + size * width;
+            if (size * width > line or begin / line == (end - 1) / line) return pos;
+            uint64_t padded = ((begin / line + 1) * line + width - 1) / width;  // next line
+            uint64_t padded_begin = padded * width;
+            if (padded_begin / line != (padded_begin + size * width - 1) / line) return pos;
+            return padded;
+        };
+
+        /*
+            The padding depends on the width, which depends on the size of the array:
+            start from the size without padding and only grow the width, until it fits.
+        */
+        uint64_t width = 0;
+        uint64_t size = num_super_kmers;
+        for (uint64_t bucket_id = 0; bucket_id != num_buckets; ++bucket_id) {
+            auto [begin, end] = locate_bucket(bucket_id);
+            if (end - begin > 1) size += 2;  // slot and header of a non-singleton bucket
+        }
+        while (pthash::util::msb(base + size - 1) + 1 > width) {
+            width = pthash::util::msb(base + size - 1) + 1;
+            size = num_buckets;
+            for (uint64_t bucket_id = 0; bucket_id != num_buckets; ++bucket_id) {
+                auto [begin, end] = locate_bucket(bucket_id);
+                if (end - begin == 1) continue;
+                size = record_position(size, end - begin + 1, width) + end - begin + 1;
+            }
+        }
+
+        pthash::compact_vector::builder cv_builder;
+        cv_builder.resize(size, width);
+        uint64_t header = num_buckets;
+        for (uint64_t bucket_id = 0; bucket_id != num_buckets; ++bucket_id) {
+            auto [begin, end] = locate_bucket(bucket_id);
+            if (end - begin == 1) {
+                cv_builder.set(bucket_id, offsets.access(begin));
+                continue;
+            }
+            header = record_position(header, end - begin + 1, width);
+            cv_builder.set(bucket_id, base + header);
+            cv_builder.set(header, end - begin);
+            for (uint64_t i = begin; i != end; ++i) cv_builder.set(++header, offsets.access(i));
+            ++header;
+        }
+        assert(header == size);
+        cv_builder.build(offsets);
+        num_super_kmers_before_bucket = ef_sequence<false>();
+        locality_base = base;
+        locality_num_super_kmers = num_super_kmers;
+    }
+
+    bool singleton_split() const { return !singleton_buckets.empty(); }
+
+    /*
+        Split the buckets into singletons and the others, marked by singleton_buckets.
+        The offsets of the singleton buckets come first, in bucket order, so that the
+        super-k-mer of a singleton bucket is found by a rank in singleton_buckets,
+        without decoding num_super_kmers_before_bucket, which is restricted to the
+        other buckets. The offsets of a non-singleton bucket keep their order.
+    */
+    void build_singleton_split(uint64_t num_buckets) {
+        assert(!locality_layout() and !singleton_split());
+        uint64_t num_super_kmers = offsets.size();
+        ranked_bit_vector singletons;
+        singletons.build(num_buckets, [&](uint64_t bucket_id) {
+            auto [begin, end] = locate_bucket(bucket_id);
+            return end - begin == 1;
+        });
+        uint64_t num_singletons = singletons.num_ones();
+
+        pthash::compact_vector::builder cv_builder;
+        cv_builder.resize(num_super_kmers, offsets.width());
+        std::vector<uint64_t> num_super_kmers_before;
+        num_super_kmers_before.reserve(num_buckets - num_singletons + 1);
+        uint64_t singleton_pos = 0;
+        uint64_t pos = num_singletons;
+        for (uint64_t bucket_id = 0; bucket_id != num_buckets; ++bucket_id) {
+            auto [begin, end] = locate_bucket(bucket_id);
+            if (end - begin == 1) {
+                cv_builder.set(singleton_pos++, offsets.access(begin));
+                continue;
+            }
+            /* the same value as before: singleton buckets do not contribute to it */
+            num_super_kmers_before.push_back(num_super_kmers_before_bucket.access(bucket_id));
+            for (uint64_t i = begin; i != end; ++i) cv_builder.set(pos++, offsets.access(i));
+        }
+        assert(singleton_pos == num_singletons and pos == num_super_kmers);
+        num_super_kmers_before.push_back(num_super_kmers - num_buckets);
+        cv_builder.build(offsets);
+        num_super_kmers_before_bucket = ef_sequence<false>();
+        num_super_kmers_before_bucket.encode(num_super_kmers_before.begin(),
+                                             num_super_kmers_before.size(),
+                                             num_super_kmers_before.back());
+        singleton_buckets.swap(singletons);
+    }
+
     uint64_t num_bits() const {
-        return pieces.num_bits() + num_super_kmers_before_bucket.num_bits() +
-               8 * (offsets.bytes() + strings.bytes());
+        return pieces.num_bits() + num_kmers_before_contig.num_bits() +
+               num_super_kmers_before_bucket.num_bits() + 8 * (offsets.bytes() + strings.bytes()) +
+               (locality_layout() ? 8 * (sizeof(locality_base) + sizeof(locality_num_super_kmers))
+                                  : 0) +
+               singleton_buckets.num_bits();
     }
 
     template <typename Visitor>
     void visit(Visitor& visitor) {
         visitor.visit(pieces);
+        visitor.visit(num_kmers_before_contig);
         visitor.visit(num_super_kmers_before_bucket);
         visitor.visit(offsets);
         visitor.visit(strings);
+        uint8_t has_locality_layout = locality_layout();
+        visitor.visit(has_locality_layout);
+        if (has_locality_layout) {
+            visitor.visit(locality_base);
+            visitor.visit(locality_num_super_kmers);
+        }
+        uint8_t has_singleton_split = singleton_split();
+        visitor.visit(has_singleton_split);
+        if (has_singleton_split) visitor.visit(singleton_buckets);
     }
 
     ef_sequence<true> pieces;
+    ef_sequence<true> num_kmers_before_contig;  // pieces[i] - i * (k - 1)
     ef_sequence<false> num_super_kmers_before_bucket;
     pthash::compact_vector offsets;
     pthash::bit_vector strings;
+    uint64_t locality_base;  // 0 unless in locality layout (see build_locality_layout)
+    uint64_t locality_num_super_kmers;
+    ranked_bit_vector singleton_buckets;  // empty unless split (see build_singleton_split)
 
 private:
+    /*
+        Return the position w in [0, window_size) of the first k-mer starting at
+        offset + w that is equal to target_kmer (or to target_kmer_rc, if check_rc),
+        together with its orientation. Return window_size if there is no match.
+        With 64-bit k-mers, the whole window lies within three words of strings and
+        its k-mers are extracted and compared in parallel by compare_lanes.
+    */
+    template <bool check_rc>
+    std::pair<uint64_t, bool> scan_window(uint64_t offset, uint64_t window_size,
+                                          kmer_t target_kmer, kmer_t target_kmer_rc,
+                                          uint64_t k) const {
+#if defined(__AVX512F__) || defined(__AVX2__)
+        if constexpr (sizeof(kmer_t) == sizeof(uint64_t)) {
+            assert(2 * k < 64);
+            assert((2 * offset & 63) + 2 * (window_size - 1) < 128);
+            uint64_t const* data = strings.data().data();
+            uint64_t num_words = strings.data().size();
+            uint64_t block = (2 * offset) >> 6;
+            uint64_t shift = (2 * offset) & 63;
+            uint64_t words[3] = {data[block], block + 1 < num_words ? data[block + 1] : 0,
+                                 block + 2 < num_words ? data[block + 2] : 0};
+            uint64_t mask = (uint64_t(1) << (2 * k)) - 1;
+            for (uint64_t w = 0; w < window_size; w += simd_lanes) {
+                auto [eq, eq_rc] = compare_lanes<check_rc>(words, shift + 2 * w, mask,
+                                                           target_kmer, target_kmer_rc);
+                uint64_t valid = window_size - w >= simd_lanes
+                                     ? (uint64_t(1) << simd_lanes) - 1
+                                     : (uint64_t(1) << (window_size - w)) - 1;
+                eq &= valid;
+                eq_rc &= valid;
+                if (eq | eq_rc) {
+                    uint64_t i = __builtin_ctzll(eq | eq_rc);
+                    /* forward has priority over reverse complement at the same position */
+                    bool orientation = (eq >> i) & 1 ? constants::forward_orientation
+                                                     : constants::backward_orientation;
+                    return {w + i, orientation};
+                }
+            }
+            return {window_size, constants::forward_orientation};
+        }
+#endif
+        bit_vector_iterator bv_it(strings, 2 * offset);
+        for (uint64_t w = 0; w != window_size; ++w) {
+            kmer_t read_kmer = bv_it.read_and_advance_by_two(2 * k);
+            if (read_kmer == target_kmer) return {w, constants::forward_orientation};
+            if (check_rc and read_kmer == target_kmer_rc) {
+                return {w, constants::backward_orientation};
+            }
+        }
+        return {window_size, constants::forward_orientation};
+    }
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+    /*
+        Extract the k-mers at bit positions shift, shift + 2, ..., of words and
+        return the bitmasks of the lanes equal to target_kmer and target_kmer_rc.
+        The k-mer at position s < 128 is
+            (w0 >> s | w1 << (64 - s) | w1 >> (s - 64) | w2 << (128 - s)) & mask
+        since variable shifts by 64 or more (including "negative" amounts) give 0.
+    */
+#if defined(__AVX512F__)
+    static constexpr uint64_t simd_lanes = 8;
+
+    template <bool check_rc>
+    static std::pair<uint64_t, uint64_t> compare_lanes(uint64_t const* words, uint64_t shift,
+                                                       uint64_t mask, uint64_t target_kmer,
+                                                       uint64_t target_kmer_rc) {
+        __m512i s = _mm512_add_epi64(_mm512_set1_epi64(shift),
+                                     _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14));
+        __m512i w0 = _mm512_set1_epi64(words[0]);
+        __m512i w1 = _mm512_set1_epi64(words[1]);
+        __m512i w2 = _mm512_set1_epi64(words[2]);
+        __m512i s_minus_64 = _mm512_sub_epi64(s, _mm512_set1_epi64(64));
+        __m512i _64_minus_s = _mm512_sub_epi64(_mm512_set1_epi64(64), s);
+        __m512i _128_minus_s = _mm512_sub_epi64(_mm512_set1_epi64(128), s);
+        /* the zero-masking forms avoid a spurious -Wmaybe-uninitialized with GCC 12 */
+        constexpr __mmask8 all = 0xFF;
+        __m512i kmers = _mm512_or_si512(
+            _mm512_or_si512(_mm512_maskz_srlv_epi64(all, w0, s),
+                            _mm512_maskz_sllv_epi64(all, w1, _64_minus_s)),
+            _mm512_or_si512(_mm512_maskz_srlv_epi64(all, w1, s_minus_64),
+                            _mm512_maskz_sllv_epi64(all, w2, _128_minus_s)));
+        kmers = _mm512_and_si512(kmers, _mm512_set1_epi64(mask));
+        uint64_t eq = _mm512_cmpeq_epi64_mask(kmers, _mm512_set1_epi64(target_kmer));
+        uint64_t eq_rc =
+            check_rc ? _mm512_cmpeq_epi64_mask(kmers, _mm512_set1_epi64(target_kmer_rc)) : 0;
+        return {eq, eq_rc};
+    }
+#else
+    static constexpr uint64_t simd_lanes = 4;
+
+    template <bool check_rc>
+    static std::pair<uint64_t, uint64_t> compare_lanes(uint64_t const* words, uint64_t shift,
+                                                       uint64_t mask, uint64_t target_kmer,
+                                                       uint64_t target_kmer_rc) {
+        __m256i s = _mm256_add_epi64(_mm256_set1_epi64x(shift), _mm256_setr_epi64x(0, 2, 4, 6));
+        __m256i w0 = _mm256_set1_epi64x(words[0]);
+        __m256i w1 = _mm256_set1_epi64x(words[1]);
+        __m256i w2 = _mm256_set1_epi64x(words[2]);
+        __m256i c64 = _mm256_set1_epi64x(64);
+        __m256i c128 = _mm256_set1_epi64x(128);
+        __m256i kmers = _mm256_or_si256(
+            _mm256_or_si256(_mm256_srlv_epi64(w0, s),
+                            _mm256_sllv_epi64(w1, _mm256_sub_epi64(c64, s))),
+            _mm256_or_si256(_mm256_srlv_epi64(w1, _mm256_sub_epi64(s, c64)),
+                            _mm256_sllv_epi64(w2, _mm256_sub_epi64(c128, s))));
+        kmers = _mm256_and_si256(kmers, _mm256_set1_epi64x(mask));
+        auto movemask = [](__m256i x) { return _mm256_movemask_pd(_mm256_castsi256_pd(x)); };
+        uint64_t eq = movemask(_mm256_cmpeq_epi64(kmers, _mm256_set1_epi64x(target_kmer)));
+        uint64_t eq_rc =
+            check_rc ? movemask(_mm256_cmpeq_epi64(kmers, _mm256_set1_epi64x(target_kmer_rc)))
+                     : 0;
+        return {eq, eq_rc};
+    }
+#endif
+#endif
+
     bool is_valid(lookup_result res) const {
          return (res.contig_size != constants::invalid_uint64 and
                  res.kmer_id_in_contig < res.contig_size) and
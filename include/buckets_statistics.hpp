@@ -38,6 +38,22 @@ struct buckets_statistics {
             m_string_sizes[num_kmers_in_super_kmer] += 1;
     }
 
+    /* Accumulate the statistics collected (for other buckets) by rhs. */
+    void merge(buckets_statistics const& rhs) {
+        assert(m_bucket_sizes.size() == rhs.m_bucket_sizes.size());
+        for (uint64_t i = 0; i != m_bucket_sizes.size(); ++i) {
+            m_bucket_sizes[i] += rhs.m_bucket_sizes[i];
+            m_total_kmers[i] += rhs.m_total_kmers[i];
+        }
+        for (uint64_t i = 0; i != m_string_sizes.size(); ++i) {
+            m_string_sizes[i] += rhs.m_string_sizes[i];
+        }
+        m_max_num_kmers_in_super_kmer =
+            std::max(m_max_num_kmers_in_super_kmer, rhs.m_max_num_kmers_in_super_kmer);
+        m_max_num_super_kmers_in_bucket =
+            std::max(m_max_num_super_kmers_in_bucket, rhs.m_max_num_super_kmers_in_bucket);
+    }
+
     uint64_t num_kmers() const { return m_num_kmers; }
     uint64_t num_buckets() const { return m_num_buckets; }
     uint64_t max_num_super_kmers_in_bucket() const { return m_max_num_super_kmers_in_bucket; }
@@ -6,14 +6,15 @@
 #include "parse_file.hpp"
 #include "build_index.hpp"
 #include "build_skew_index.hpp"
+#include "build_filter.hpp"
 /*****************/
 
 #include <numeric>  // for std::accumulate
 
 namespace sshash {
 
-void dictionary::build(std::string const& filename, build_configuration const& build_config) {
-    /* Validate the build configuration. */
+/* Validate the build configuration. */
+static void validate(build_configuration const& build_config) {
     if (build_config.k == 0) throw std::runtime_error("k must be > 0");
     if (build_config.k > constants::max_k) {
         throw std::runtime_error("k must be less <= " + std::to_string(constants::max_k) +
@@ -28,15 +29,22 @@ void dictionary::build(std::string const& filename, build_configuration const& b
     if (build_config.l > constants::max_l) {
         throw std::runtime_error("l must be <= " + std::to_string(constants::max_l));
     }
+    if (build_config.locality_layout and build_config.singleton_split) {
+        throw std::runtime_error("locality_layout and singleton_split cannot be used together");
+    }
+}
 
+void dictionary::build(std::string const& filename, build_configuration const& build_config) {
+    validate(build_config);
     m_k = build_config.k;
     m_m = build_config.m;
     m_seed = build_config.seed;
     m_canonical_parsing = build_config.canonical_parsing;
     m_skew_index.min_log2 = build_config.l;
+    m_skew_index.c = build_config.c;
 
     std::vector<double> timings;
-    timings.reserve(5);
+    timings.reserve(6);
     essentials::timer_type timer;
 
     /* step 1: parse the input file and build compact string pool ***/
@@ -49,6 +57,14 @@ void dictionary::build(std::string const& filename, build_configuration const& b
     timer.reset();
     /******/
 
+    build(data, build_config, timings);
+}
+
+/* Steps 1.1 to 5 of the construction, from the parsed input. */
+void dictionary::build(parse_data& data, build_configuration const& build_config,
+                       std::vector<double>& timings) {
+    essentials::timer_type timer;
+
     if (build_config.weighted) {
         /* step 1.1: compress weights ***/
         timer.start();
@@ -71,11 +87,8 @@ void dictionary::build(std::string const& filename, build_configuration const& b
     timer.start();
     data.minimizers.merge();
     {
-        mm::file_source<minimizer_tuple> input(data.minimizers.get_minimizers_filename(),
-                                               mm::advice::sequential);
-        minimizers_tuples_iterator iterator(input.data(), input.data() + input.size());
+        minimizers_tuples_iterator iterator(data.minimizers.begin(), data.minimizers.end());
         m_minimizers.build(iterator, data.minimizers.num_minimizers(), build_config);
-        input.close();
     }
     timer.stop();
     timings.push_back(timer.elapsed());
@@ -101,6 +114,17 @@ void dictionary::build(std::string const& filename, build_configuration const& b
     timer.reset();
     /******/
 
+    if (build_config.filter_bits_per_kmer > 0) {
+        /* step 5: build the k-mer filter ***/
+        timer.start();
+        build_filter(m_filter, m_buckets, data.num_kmers, build_config);
+        timer.stop();
+        timings.push_back(timer.elapsed());
+        print_time(timings.back(), data.num_kmers, "step 5: 'build_filter'");
+        timer.reset();
+        /******/
+    }
+
     double total_time = std::accumulate(timings.begin(), timings.end(), 0.0);
     print_time(total_time, data.num_kmers, "total_time");
 
@@ -111,4 +135,117 @@ void dictionary::build(std::string const& filename, build_configuration const& b
     data.minimizers.remove_tmp_file();
 }
 
+void dictionary::merge(dictionary const& a, dictionary const& b,
+                       build_configuration const& build_config) {
+    if (a.k() != b.k() or a.m() != b.m() or a.seed() != b.seed() or
+        a.canonicalized() != b.canonicalized()) {
+        throw std::runtime_error("the dictionaries must have the same k, m, seed and parsing");
+    }
+    if (a.weighted() != b.weighted()) {
+        throw std::runtime_error("either both dictionaries or none must be weighted");
+    }
+    assert(build_config.k == a.k() and build_config.m == a.m());
+    assert(build_config.seed == a.seed() and build_config.canonical_parsing == a.canonicalized());
+    assert(build_config.weighted == a.weighted());
+    validate(build_config);
+
+    m_k = build_config.k;
+    m_m = build_config.m;
+    m_seed = build_config.seed;
+    m_canonical_parsing = build_config.canonical_parsing;
+    m_skew_index.min_log2 = build_config.l;
+    m_skew_index.c = build_config.c;
+
+    uint64_t k = m_k;
+    std::vector<double> timings;
+    timings.reserve(7);
+    essentials::timer_type timer;
+
+    /*
+        step 0: mark the k-mers of b that are also in a (in either orientation only for
+        canonical parsing: with regular parsing, a k-mer and its reverse complement are
+        distinct k-mers) ***/
+    timer.start();
+    std::vector<uint64_t> shared((b.size() + 63) / 64, 0);
+    b.parallel_for_each_kmer(build_config.num_threads, [&](uint64_t kmer_id, kmer_t uint_kmer) {
+        if (a.is_member_uint(uint_kmer, a.canonicalized())) {
+            __atomic_fetch_or(&shared[kmer_id / 64], uint64_t(1) << (kmer_id % 64),
+                              __ATOMIC_RELAXED);
+        }
+    });
+    auto is_shared = [&](uint64_t kmer_id) { return (shared[kmer_id / 64] >> (kmer_id % 64)) & 1; };
+    timer.stop();
+    timings.push_back(timer.elapsed());
+    print_time(timings.back(), a.size() + b.size(), "step 0: 'mark_shared_kmers'");
+    timer.reset();
+    /******/
+
+    /*
+        step 1: parse the contigs of a, then the maximal runs of k-mers of the contigs
+        of b that are not in a, in the same way as the sequences of an input file ***/
+    timer.start();
+    parse_data data(build_config);
+    weight_intervals weights(data.weights_builder);
+    uint64_t num_sequences = 0;
+    uint64_t num_bases = 0;
+
+    dictionary const* source = &a;
+    auto contig_it = a.begin_contigs();
+    contig_span span;
+    uint64_t next_kmer = 0;  // in the current contig
+    uint64_t num_kmers_in_contig = 0;
+    std::string contig;
+
+    auto read_sequence = [&](std::string_view& sequence) {
+        while (true) {
+            if (next_kmer == num_kmers_in_contig) {
+                if (!contig_it.has_next()) {
+                    if (source == &b) return false;
+                    source = &b;
+                    contig_it = b.begin_contigs();
+                    continue;
+                }
+                span = contig_it.next();
+                contig.resize(span.end - span.begin);
+                bit_vector_iterator bv_it(source->strings(), 2 * span.begin);
+                for (auto& c : contig) c = util::uint64_to_char(bv_it.get_next_two_bits());
+                next_kmer = 0;
+                num_kmers_in_contig = contig.size() - k + 1;
+            }
+            uint64_t begin = next_kmer;
+            uint64_t end = num_kmers_in_contig;
+            if (source == &b) {
+                while (begin != num_kmers_in_contig and is_shared(span.kmer_id + begin)) ++begin;
+                end = begin;
+                while (end != num_kmers_in_contig and !is_shared(span.kmer_id + end)) ++end;
+            }
+            next_kmer = end;
+            if (begin == end) continue;
+
+            if (build_config.weighted) {
+                for (uint64_t i = begin; i != end; ++i) {
+                    weights.add(source->weight(span.kmer_id + i));
+                }
+            }
+            sequence = std::string_view(contig).substr(begin, end - begin + k - 1);
+            ++num_sequences;
+            num_bases += sequence.size();
+            return true;
+        }
+    };
+
+    parse_sequences(read_sequence, data, build_config);
+    print_parse_info(data, num_sequences, num_bases, k);
+    if (build_config.weighted) weights.finalize(data.num_kmers);
+    m_size = data.num_kmers;
+    std::cout << "num_shared_kmers " << a.size() + b.size() - m_size << std::endl;
+    timer.stop();
+    timings.push_back(timer.elapsed());
+    print_time(timings.back(), data.num_kmers, "step 1: 'parse_dictionaries'");
+    timer.reset();
+    /******/
+
+    build(data, build_config, timings);
+}
+
 }  // namespace sshash
@@ -0,0 +1,40 @@
+#pragma once
+
+namespace sshash {
+
+void build_filter(kmer_filter& m_filter, buckets const& m_buckets, uint64_t num_kmers,
+                  build_configuration const& build_config) {
+    uint64_t k = build_config.k;
+    uint64_t num_contigs = m_buckets.pieces.size() - 1;
+    kmer_filter::builder builder(num_kmers, build_config.filter_bits_per_kmer);
+
+    /* each thread takes a range of contigs and rolls over their k-mers */
+    constexpr uint64_t contigs_per_range = 1024;
+    uint64_t num_ranges = (num_contigs + contigs_per_range - 1) / contigs_per_range;
+    parallel_for(num_ranges, build_config.num_threads, [&](uint64_t r) {
+        uint64_t contig_id = r * contigs_per_range;
+        uint64_t last_contig_id = std::min(contig_id + contigs_per_range, num_contigs);
+        auto pieces_it = m_buckets.pieces.at(contig_id);
+        uint64_t begin = pieces_it.next();
+        for (; contig_id != last_contig_id; ++contig_id) {
+            uint64_t end = pieces_it.next();
+            assert(end - begin >= k);
+            bit_vector_iterator bv_it(m_buckets.strings, 2 * begin);
+            for (uint64_t i = 0; i != end - begin - k + 1; ++i) {
+                kmer_t uint_kmer = bv_it.read_and_advance_by_two(2 * k);
+                if (build_config.canonical_parsing) {
+                    kmer_t uint_kmer_rc = util::compute_reverse_complement(uint_kmer, k);
+                    uint_kmer = std::min(uint_kmer, uint_kmer_rc);
+                }
+                builder.add(uint_kmer);
+            }
+            begin = end;
+        }
+    });
+
+    builder.build(m_filter);
+    std::cout << "filter: " << static_cast<double>(m_filter.num_bits()) / num_kmers
+              << " [bits/kmer], " << m_filter.num_hashes() << " hashes" << std::endl;
+}
+
+}  // namespace sshash
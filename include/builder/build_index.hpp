@@ -41,14 +41,13 @@ private:
 };
 
 struct bucket_pairs {
-    static constexpr uint64_t ram_limit = 0.25 * essentials::GB;
-
-    bucket_pairs(std::string const& tmp_dirname)
+    bucket_pairs(std::string const& tmp_dirname, uint64_t ram_limit)
         : m_buffer_size(0)
         , m_num_files_to_merge(0)
+        , m_in_memory(false)
         , m_run_identifier(pthash::clock_type::now().time_since_epoch().count())
         , m_tmp_dirname(tmp_dirname) {
-        m_buffer_size = ram_limit / sizeof(bucket_pair);
+        m_buffer_size = std::max<uint64_t>(ram_limit / sizeof(bucket_pair), 1);
         std::cout << "m_buffer_size " << m_buffer_size << std::endl;
     }
 
@@ -58,9 +57,7 @@ struct bucket_pairs {
     }
 
     void sort_and_flush() {
-        std::cout << "sorting buffer..." << std::endl;
-        std::sort(m_buffer.begin(), m_buffer.end(),
-                  [](bucket_pair const& x, bucket_pair const& y) { return x.id < y.id; });
+        sort();
 
         auto tmp_output_filename = get_tmp_output_filename(m_num_files_to_merge);
         std::cout << "saving to file '" << tmp_output_filename << "'..." << std::endl;
@@ -75,6 +72,12 @@ struct bucket_pairs {
     }
 
     void finalize() {
+        if (m_num_files_to_merge == 0) {
+            /* all pairs fit into the buffer: keep them in memory, without tmp files */
+            sort();
+            m_in_memory = true;
+            return;
+        }
         if (!m_buffer.empty()) sort_and_flush();
     }
 
@@ -99,8 +102,16 @@ struct bucket_pairs {
 
     files_name_iterator files_name_iterator_begin() { return files_name_iterator(this); }
 
+    /*
+        Merge the sorted runs. After this call, the sorted pairs are available
+        in [begin(), end()), either from memory or memory-mapped from disk.
+    */
     void merge() {
-        if (m_num_files_to_merge <= 1) return;
+        if (m_in_memory) return;
+        if (m_num_files_to_merge == 1) {
+            m_input.open(get_bucket_pairs_filename(), mm::advice::sequential);
+            return;
+        }
         assert(m_num_files_to_merge > 1);
 
         std::cout << " == files to merge = " << m_num_files_to_merge << std::endl;
@@ -135,17 +146,40 @@ struct bucket_pairs {
         }
 
         std::vector<bucket_pair>().swap(m_buffer);
+
+        m_input.open(get_bucket_pairs_filename(), mm::advice::sequential);
     }
 
-    uint64_t num_files_to_merge() const { return m_num_files_to_merge; }
-    void remove_tmp_file() { std::remove(get_bucket_pairs_filename().c_str()); }
+    bucket_pair const* begin() const { return m_in_memory ? m_buffer.data() : m_input.data(); }
+    bucket_pair const* end() const {
+        return m_in_memory ? m_buffer.data() + m_buffer.size() : m_input.data() + m_input.size();
+    }
+
+    bool empty() const { return m_num_files_to_merge == 0 and m_buffer.empty(); }
+
+    void remove_tmp_file() {
+        if (m_in_memory) {
+            std::vector<bucket_pair>().swap(m_buffer);
+            return;
+        }
+        m_input.close();
+        std::remove(get_bucket_pairs_filename().c_str());
+    }
 
 private:
     uint64_t m_buffer_size;
     uint64_t m_num_files_to_merge;
+    bool m_in_memory;
     uint64_t m_run_identifier;
     std::string m_tmp_dirname;
     std::vector<bucket_pair> m_buffer;
+    mm::file_source<bucket_pair> m_input;
+
+    void sort() {
+        std::cout << "sorting buffer..." << std::endl;
+        std::sort(m_buffer.begin(), m_buffer.end(),
+                  [](bucket_pair const& x, bucket_pair const& y) { return x.id < y.id; });
+    }
 
     std::string get_tmp_output_filename(uint64_t id) const {
         std::stringstream filename;
@@ -167,13 +201,11 @@ buckets_statistics build_index(parse_data& data, minimizers const& m_minimizers,
     std::cout << "bits_per_offset = ceil(log2(" << data.strings.num_bits() / 2
               << ")) = " << std::ceil(std::log2(data.strings.num_bits() / 2)) << std::endl;
 
-    mm::file_source<minimizer_tuple> input(data.minimizers.get_minimizers_filename(),
-                                           mm::advice::sequential);
-
-    bucket_pairs bucket_pairs_manager(build_config.tmp_dirname);
+    /* the pairs share the RAM with the offsets and the tuples */
+    bucket_pairs bucket_pairs_manager(build_config.tmp_dirname, build_config.ram / 8);
     uint64_t num_singletons = 0;
-    for (minimizers_tuples_iterator it(input.data(), input.data() + input.size()); it.has_next();
-         it.next()) {
+    for (minimizers_tuples_iterator it(data.minimizers.begin(), data.minimizers.end());
+         it.has_next(); it.next()) {
         uint32_t list_size = it.list().size();
         assert(list_size > 0);
         if (list_size != 1) {
@@ -188,15 +220,11 @@ buckets_statistics build_index(parse_data& data, minimizers const& m_minimizers,
     std::cout << "num_singletons " << num_singletons << "/" << num_buckets << " ("
               << (num_singletons * 100.0) / num_buckets << "%)" << std::endl;
 
-    if (bucket_pairs_manager.num_files_to_merge() > 0) {
+    if (!bucket_pairs_manager.empty()) {
         bucket_pairs_manager.merge();
-        mm::file_source<bucket_pair> bucket_pairs_file(
-            bucket_pairs_manager.get_bucket_pairs_filename(), mm::advice::sequential);
-        bucket_pairs_iterator iterator(bucket_pairs_file.data(),
-                                       bucket_pairs_file.data() + bucket_pairs_file.size());
+        bucket_pairs_iterator iterator(bucket_pairs_manager.begin(), bucket_pairs_manager.end());
         m_buckets.num_super_kmers_before_bucket.encode(iterator, num_buckets + 1,
                                                        num_super_kmers - num_buckets);
-        bucket_pairs_file.close();
         bucket_pairs_manager.remove_tmp_file();
     } else {
         /* all buckets are singletons, thus pass an empty iterator that always returns 0 */
@@ -207,30 +235,75 @@ buckets_statistics build_index(parse_data& data, minimizers const& m_minimizers,
 
     buckets_statistics buckets_stats(num_buckets, num_kmers, num_super_kmers);
 
-    for (minimizers_tuples_iterator it(input.data(), input.data() + input.size()); it.has_next();
-         it.next()) {
-        uint64_t bucket_id = m_minimizers.lookup(it.minimizer());
-        uint64_t base = m_buckets.num_super_kmers_before_bucket.access(bucket_id) + bucket_id;
-        uint64_t num_super_kmers_in_bucket =
-            (m_buckets.num_super_kmers_before_bucket.access(bucket_id + 1) + bucket_id + 1) - base;
-        assert(num_super_kmers_in_bucket > 0);
-        buckets_stats.add_num_super_kmers_in_bucket(num_super_kmers_in_bucket);
-        uint64_t offset_pos = 0;
-        auto list = it.list();
-        for (auto [offset, num_kmers_in_super_kmer] : list) {
-            offsets.set(base + offset_pos++, offset);
-            buckets_stats.add_num_kmers_in_super_kmer(num_super_kmers_in_bucket,
-                                                      num_kmers_in_super_kmer);
+    /*
+        Fill the offsets: split the tuples into one range per thread, with boundaries
+        aligned to the beginning of a minimizer, so that each bucket is written by
+        a single thread.
+    */
+    uint64_t num_threads = build_config.num_threads;
+    std::vector<minimizer_tuple const*> boundaries;
+    boundaries.push_back(data.minimizers.begin());
+    {
+        minimizer_tuple const* end = data.minimizers.end();
+        uint64_t num_tuples = end - data.minimizers.begin();
+        for (uint64_t t = 1; t < num_threads; ++t) {
+            minimizer_tuple const* p = data.minimizers.begin() + (t * num_tuples) / num_threads;
+            p = std::max(p, boundaries.back());
+            while (p != end and p != data.minimizers.begin() and
+                   (*p).minimizer == (*(p - 1)).minimizer) {
+                ++p;
+            }
+            boundaries.push_back(p);
         }
-        assert(offset_pos == num_super_kmers_in_bucket);
+        boundaries.push_back(end);
     }
 
+    std::vector<buckets_statistics> thread_stats(
+        boundaries.size() - 1, buckets_statistics(num_buckets, num_kmers, num_super_kmers));
+    parallel_for(boundaries.size() - 1, num_threads, [&](uint64_t t) {
+        if (boundaries[t] == boundaries[t + 1]) return;
+        for (minimizers_tuples_iterator it(boundaries[t], boundaries[t + 1]); it.has_next();
+             it.next()) {
+            uint64_t bucket_id = m_minimizers.lookup(it.minimizer());
+            uint64_t base = m_buckets.num_super_kmers_before_bucket.access(bucket_id) + bucket_id;
+            uint64_t num_super_kmers_in_bucket =
+                (m_buckets.num_super_kmers_before_bucket.access(bucket_id + 1) + bucket_id + 1) -
+                base;
+            assert(num_super_kmers_in_bucket > 0);
+            thread_stats[t].add_num_super_kmers_in_bucket(num_super_kmers_in_bucket);
+            uint64_t offset_pos = 0;
+            auto list = it.list();
+            for (auto [offset, num_kmers_in_super_kmer] : list) {
+                if (num_threads == 1) {
+                    offsets.set(base + offset_pos++, offset);
+                } else {
+                    atomic_set(offsets, base + offset_pos++, offset);
+                }
+                thread_stats[t].add_num_kmers_in_super_kmer(num_super_kmers_in_bucket,
+                                                            num_kmers_in_super_kmer);
+            }
+            assert(offset_pos == num_super_kmers_in_bucket);
+        }
+    });
+    for (auto const& stats : thread_stats) buckets_stats.merge(stats);
+
     m_buckets.pieces.encode(data.strings.pieces.begin(), data.strings.pieces.size(),
                             data.strings.pieces.back());
+    {
+        /* map k-mer ids to contig ids with a single prev_leq, see buckets::id_to_contig */
+        std::vector<uint64_t> num_kmers_before_contig(data.strings.pieces.size());
+        for (uint64_t i = 0; i != num_kmers_before_contig.size(); ++i) {
+            num_kmers_before_contig[i] = data.strings.pieces[i] - i * (build_config.k - 1);
+        }
+        assert(num_kmers_before_contig.back() == num_kmers);
+        m_buckets.num_kmers_before_contig.encode(num_kmers_before_contig.begin(),
+                                                 num_kmers_before_contig.size(),
+                                                 num_kmers_before_contig.back());
+    }
     offsets.build(m_buckets.offsets);
     m_buckets.strings.swap(data.strings.strings);
-
-    input.close();
+    if (build_config.locality_layout) m_buckets.build_locality_layout(num_buckets);
+    if (build_config.singleton_split) m_buckets.build_singleton_split(num_buckets);
 
     return buckets_stats;
 }
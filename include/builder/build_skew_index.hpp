@@ -18,13 +18,10 @@ void build_skew_index(skew_index& m_skew_index, parse_data& data, buckets const&
     std::cout << "log2_max_num_super_kmers_in_bucket "
               << m_skew_index.log2_max_num_super_kmers_in_bucket << std::endl;
 
-    mm::file_source<minimizer_tuple> input(data.minimizers.get_minimizers_filename(),
-                                           mm::advice::sequential);
-
     uint64_t num_buckets_in_skew_index = 0;
     uint64_t num_super_kmers_in_skew_index = 0;
-    for (minimizers_tuples_iterator it(input.data(), input.data() + input.size()); it.has_next();
-         it.next()) {
+    for (minimizers_tuples_iterator it(data.minimizers.begin(), data.minimizers.end());
+         it.has_next(); it.next()) {
         uint64_t list_size = it.list().size();
         if (list_size > (1ULL << min_log2_size)) {
             num_super_kmers_in_skew_index += list_size;
@@ -36,17 +33,14 @@ void build_skew_index(skew_index& m_skew_index, parse_data& data, buckets const&
               << (num_buckets_in_skew_index * 100.0) / buckets_stats.num_buckets() << "%)"
               << std::endl;
 
-    if (num_buckets_in_skew_index == 0) {
-        input.close();
-        return;
-    }
+    if (num_buckets_in_skew_index == 0) return;
 
     std::vector<list_type> lists;
     lists.reserve(num_buckets_in_skew_index);
     std::vector<minimizer_tuple> lists_tuples;  // backed memory
     lists_tuples.reserve(num_super_kmers_in_skew_index);
-    for (minimizers_tuples_iterator it(input.data(), input.data() + input.size()); it.has_next();
-         it.next()) {
+    for (minimizers_tuples_iterator it(data.minimizers.begin(), data.minimizers.end());
+         it.has_next(); it.next()) {
         auto list = it.list();
         if (list.size() > (1ULL << min_log2_size)) {
             minimizer_tuple const* begin = lists_tuples.data() + lists_tuples.size();
@@ -56,7 +50,6 @@ void build_skew_index(skew_index& m_skew_index, parse_data& data, buckets const&
         }
     }
     assert(lists.size() == num_buckets_in_skew_index);
-    input.close();
 
     std::sort(lists.begin(), lists.end(),
               [](list_type const& x, list_type const& y) { return x.size() < y.size(); });
@@ -68,6 +61,10 @@ void build_skew_index(skew_index& m_skew_index, parse_data& data, buckets const&
     std::cout << "num_partitions " << num_partitions << std::endl;
 
     std::vector<uint64_t> num_kmers_in_partition(num_partitions, 0);
+    /* the lists of partition p are lists[partition_begin[p]..partition_begin[p+1]) */
+    std::vector<uint64_t> partition_begin;
+    partition_begin.reserve(num_partitions + 1);
+    partition_begin.push_back(0);
     m_skew_index.mphfs.resize(num_partitions);
     m_skew_index.positions.resize(num_partitions);
 
@@ -91,6 +88,7 @@ void build_skew_index(skew_index& m_skew_index, parse_data& data, buckets const&
                 }
                 num_kmers_in_skew_index += num_kmers_in_partition[partition_id];
                 partition_id += 1;
+                partition_begin.push_back(i);
 
                 if (i == lists.size()) break;
 
@@ -117,6 +115,7 @@ void build_skew_index(skew_index& m_skew_index, parse_data& data, buckets const&
             }
         }
         assert(partition_id == num_partitions);
+        assert(partition_begin.size() == num_partitions + 1);
         std::cout << "num_kmers_in_skew_index " << num_kmers_in_skew_index << "("
                   << (num_kmers_in_skew_index * 100.0) / buckets_stats.num_kmers() << "%)"
                   << std::endl;
@@ -126,95 +125,128 @@ void build_skew_index(skew_index& m_skew_index, parse_data& data, buckets const&
     }
 
     {
-        pthash::build_configuration mphf_config;
-        mphf_config.c = build_config.c;
-        mphf_config.alpha = 0.94;
-        mphf_config.seed = 1234567890;  // my favourite seed
-        mphf_config.minimal_output = true;
-        mphf_config.verbose_output = false;
-        mphf_config.num_partitions = std::thread::hardware_concurrency(); 
-        mphf_config.num_threads = std::thread::hardware_concurrency();
-
-        std::cout << "building PTHash mphfs (with " << mphf_config.num_threads
-                  << " threads) and positions..." << std::endl;
-
-        uint64_t partition_id = 0;
-        uint64_t lower = 1ULL << min_log2_size;
-        uint64_t upper = 2 * lower;
-        uint64_t num_bits_per_pos = min_log2_size + 1;
-
-        /* tmp storage for keys and super_kmer_ids ******/
-        std::vector<kmer_t> keys_in_partition;
-        std::vector<uint32_t> super_kmer_ids_in_partition;
-        keys_in_partition.reserve(num_kmers_in_partition[partition_id]);
-        super_kmer_ids_in_partition.reserve(num_kmers_in_partition[partition_id]);
-        pthash::compact_vector::builder cvb_positions;
-        cvb_positions.resize(num_kmers_in_partition[partition_id], num_bits_per_pos);
-        /*******/
-
-        for (uint64_t i = 0; i != lists.size() + 1; ++i) {
-            if (i == lists.size() or lists[i].size() > upper) {
-                std::cout << "lower " << lower << "; upper " << upper << "; num_bits_per_pos "
-                          << num_bits_per_pos << "; keys_in_partition.size() "
-                          << keys_in_partition.size() << std::endl;
-
-                auto& mphf = m_skew_index.mphfs[partition_id];
-                assert(num_kmers_in_partition[partition_id] == keys_in_partition.size());
-                assert(num_kmers_in_partition[partition_id] == super_kmer_ids_in_partition.size());
-                mphf.build_in_internal_memory(keys_in_partition.begin(), keys_in_partition.size(),
-                                              mphf_config);
-
-                std::cout << "  built mphs[" << partition_id << "] for " << keys_in_partition.size()
-                          << " keys; bits/key = "
-                          << static_cast<double>(mphf.num_bits()) / mphf.num_keys() << std::endl;
-
-                for (uint64_t i = 0; i != keys_in_partition.size(); ++i) {
-                    kmer_t kmer = keys_in_partition[i];
-                    uint64_t pos = mphf(kmer);
-                    uint32_t super_kmer_id = super_kmer_ids_in_partition[i];
-                    cvb_positions.set(pos, super_kmer_id);
+        /* position of the first k-mer of each list in the keys of its partition */
+        std::vector<uint64_t> list_offsets(lists.size());
+        for (uint64_t partition_id = 0; partition_id != num_partitions; ++partition_id) {
+            uint64_t offset = 0;
+            for (uint64_t i = partition_begin[partition_id]; i != partition_begin[partition_id + 1];
+                 ++i) {
+                list_offsets[i] = offset;
+                for (auto [_, num_kmers_in_super_kmer] : lists[i]) {
+                    (void)_;
+                    offset += num_kmers_in_super_kmer;
                 }
-                auto& positions = m_skew_index.positions[partition_id];
-                cvb_positions.build(positions);
-
-                std::cout << "  built positions[" << partition_id << "] for " << positions.size()
-                          << " keys; bits/key = " << (positions.bytes() * 8.0) / positions.size()
-                          << std::endl;
-
-                partition_id += 1;
-
-                if (i == lists.size()) break;
+            }
+            assert(offset == num_kmers_in_partition[partition_id]);
+        }
 
-                lower = upper;
-                upper = 2 * lower;
-                num_bits_per_pos += 1;
+        /*
+            Partitions are processed in batches whose tmp storage fits into the RAM budget:
+            the k-mers of all the lists of a batch are extracted in parallel, then the
+            MPHFs and positions of the partitions of the batch are built concurrently.
+        */
+        uint64_t num_threads = build_config.num_threads;
+        constexpr uint64_t bytes_per_key = sizeof(kmer_t) + sizeof(uint32_t) +
+                                           minimizers::mphf_bytes_per_key_in_internal_memory;
+
+        std::cout << "building PTHash mphfs and positions (with " << num_threads
+                  << " threads)..." << std::endl;
+
+        for (uint64_t batch_begin = 0; batch_begin != num_partitions;) {
+            uint64_t batch_end = batch_begin + 1;
+            uint64_t batch_bytes = num_kmers_in_partition[batch_begin] * bytes_per_key;
+            while (num_threads > 1 and batch_end != num_partitions and
+                   batch_bytes + num_kmers_in_partition[batch_end] * bytes_per_key <=
+                       build_config.ram) {
+                batch_bytes += num_kmers_in_partition[batch_end] * bytes_per_key;
+                ++batch_end;
+            }
+            uint64_t batch_size = batch_end - batch_begin;
+
+            /* tmp storage for keys and super_kmer_ids ******/
+            std::vector<std::vector<kmer_t>> keys_in_partition(batch_size);
+            std::vector<std::vector<uint32_t>> super_kmer_ids_in_partition(batch_size);
+            for (uint64_t j = 0; j != batch_size; ++j) {
+                keys_in_partition[j].resize(num_kmers_in_partition[batch_begin + j]);
+                super_kmer_ids_in_partition[j].resize(num_kmers_in_partition[batch_begin + j]);
+            }
+            /*******/
+
+            uint64_t lists_begin = partition_begin[batch_begin];
+            uint64_t lists_end = partition_begin[batch_end];
+            parallel_for(lists_end - lists_begin, num_threads, [&](uint64_t i) {
+                i += lists_begin;
+                uint64_t j =
+                    std::upper_bound(partition_begin.begin() + batch_begin,
+                                     partition_begin.begin() + batch_end, i) -
+                    (partition_begin.begin() + batch_begin) - 1;
+                assert(j < batch_size);
+                kmer_t* keys = keys_in_partition[j].data() + list_offsets[i];
+                uint32_t* super_kmer_ids = super_kmer_ids_in_partition[j].data() + list_offsets[i];
+                uint64_t super_kmer_id = 0;
+                for (auto [offset, num_kmers_in_super_kmer] : lists[i]) {
+                    bit_vector_iterator bv_it(m_buckets.strings, 2 * offset);
+                    for (uint64_t w = 0; w != num_kmers_in_super_kmer; ++w) {
+                        *keys++ = bv_it.read(2 * build_config.k);
+                        *super_kmer_ids++ = super_kmer_id;
+                        bv_it.eat(2);
+                    }
+                    ++super_kmer_id;
+                }
+            });
+
+            std::vector<std::stringstream> logs(batch_size);
+            parallel_for(batch_size, batch_size, [&](uint64_t j) {
+                uint64_t partition_id = batch_begin + j;
+                uint64_t lower = 1ULL << (min_log2_size + partition_id);
+                uint64_t upper = 2 * lower;
+                uint64_t num_bits_per_pos = min_log2_size + 1 + partition_id;
                 if (partition_id == num_partitions - 1) {
                     upper = max_num_super_kmers_in_bucket;
                     num_bits_per_pos = m_skew_index.log2_max_num_super_kmers_in_bucket;
                 }
+                auto const& keys = keys_in_partition[j];
+                auto const& super_kmer_ids = super_kmer_ids_in_partition[j];
+
+                logs[j] << "lower " << lower << "; upper " << upper << "; num_bits_per_pos "
+                       << num_bits_per_pos << "; keys_in_partition.size() " << keys.size()
+                       << std::endl;
+
+                pthash::build_configuration mphf_config;
+                mphf_config.c = build_config.c;
+                mphf_config.alpha = 0.94;
+                mphf_config.seed = 1234567890;  // my favourite seed
+                mphf_config.minimal_output = true;
+                mphf_config.verbose_output = false;
+                mphf_config.num_partitions = std::thread::hardware_concurrency();
+                mphf_config.num_threads =
+                    std::max<uint64_t>(std::thread::hardware_concurrency() / batch_size, 1);
 
-                keys_in_partition.clear();
-                super_kmer_ids_in_partition.clear();
-                keys_in_partition.reserve(num_kmers_in_partition[partition_id]);
-                super_kmer_ids_in_partition.reserve(num_kmers_in_partition[partition_id]);
-                cvb_positions.resize(num_kmers_in_partition[partition_id], num_bits_per_pos);
-            }
-
-            assert(lists[i].size() > lower and lists[i].size() <= upper);
-            uint64_t super_kmer_id = 0;
-            for (auto [offset, num_kmers_in_super_kmer] : lists[i]) {
-                bit_vector_iterator bv_it(m_buckets.strings, 2 * offset);
-                for (uint64_t i = 0; i != num_kmers_in_super_kmer; ++i) {
-                    kmer_t kmer = bv_it.read(2 * build_config.k);
-                    keys_in_partition.push_back(kmer);
-                    super_kmer_ids_in_partition.push_back(super_kmer_id);
-                    bv_it.eat(2);
+                auto& mphf = m_skew_index.mphfs[partition_id];
+                mphf.build_in_internal_memory(keys.begin(), keys.size(), mphf_config);
+
+                logs[j] << "  built mphs[" << partition_id << "] for " << keys.size()
+                       << " keys; bits/key = "
+                       << static_cast<double>(mphf.num_bits()) / mphf.num_keys() << std::endl;
+
+                pthash::compact_vector::builder cvb_positions;
+                cvb_positions.resize(keys.size(), num_bits_per_pos);
+                for (uint64_t i = 0; i != keys.size(); ++i) {
+                    uint64_t pos = mphf(keys[i]);
+                    assert(super_kmer_ids[i] < (1ULL << cvb_positions.width()));
+                    cvb_positions.set(pos, super_kmer_ids[i]);
                 }
-                assert(super_kmer_id < (1ULL << cvb_positions.width()));
-                ++super_kmer_id;
-            }
+                auto& positions = m_skew_index.positions[partition_id];
+                cvb_positions.build(positions);
+
+                logs[j] << "  built positions[" << partition_id << "] for " << positions.size()
+                       << " keys; bits/key = " << (positions.bytes() * 8.0) / positions.size()
+                       << std::endl;
+            });
+            for (auto const& l : logs) std::cout << l.str();
+
+            batch_begin = batch_end;
         }
-        assert(partition_id == num_partitions);
     }
 
     std::cout << "num_bits_for_skew_index " << m_skew_index.num_bits() << "("
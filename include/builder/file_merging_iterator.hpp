@@ -1,6 +1,6 @@
 #pragma once
 
-#include <functional>
+#include <algorithm>
 
 namespace sshash {
 
@@ -22,7 +22,7 @@ struct file_merging_iterator {
                                      m_mm_files[i].data() + m_mm_files[i].size());
             m_idx_heap.push_back(i);
         }
-        std::make_heap(m_idx_heap.begin(), m_idx_heap.end(), heap_idx_comparator);
+        std::make_heap(m_idx_heap.begin(), m_idx_heap.end(), comparator());
     }
 
     bool has_next() { return !m_idx_heap.empty(); }
@@ -41,9 +41,13 @@ private:
     std::vector<uint32_t> m_idx_heap;
     std::vector<mm::file_source<uint8_t>> m_mm_files;
 
-    std::function<bool(uint32_t, uint32_t)> heap_idx_comparator = [&](uint32_t i, uint32_t j) {
+    inline bool heap_idx_comparator(uint32_t i, uint32_t j) const {
         return (*m_iterators[i]) > (*m_iterators[j]);
-    };
+    }
+
+    auto comparator() const {
+        return [this](uint32_t i, uint32_t j) { return heap_idx_comparator(i, j); };
+    }
 
     void advance_heap_head() {
         uint32_t idx = m_idx_heap.front();
@@ -59,7 +63,7 @@ private:
                 pos = i;
             }
         } else {
-            std::pop_heap(m_idx_heap.begin(), m_idx_heap.end(), heap_idx_comparator);
+            std::pop_heap(m_idx_heap.begin(), m_idx_heap.end(), comparator());
             m_idx_heap.pop_back();
         }
     };
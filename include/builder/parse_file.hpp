@@ -1,49 +1,47 @@
 #pragma once
 
-#include "../gz/zip_stream.hpp"
+#include <thread>
+
+#include "../gz/threaded_zip_stream.hpp"
+#include "../fastx_reader.hpp"
+#include "../minimizer_enumerator.hpp"
 
 namespace sshash {
 
 struct parse_data {
-    parse_data(std::string const& tmp_dirname) : num_kmers(0), minimizers(tmp_dirname) {}
+    /* the tuples share the RAM with the string pool */
+    parse_data(build_configuration const& build_config)
+        : num_kmers(0)
+        , minimizers(build_config.tmp_dirname, build_config.ram / 4, build_config.num_threads) {}
     uint64_t num_kmers;
     minimizers_tuples minimizers;
     compact_string_pool strings;
     weights::builder weights_builder;
 };
 
-void parse_file(std::istream& is, parse_data& data, build_configuration const& build_config) {
+/*
+    Split the sequence into super-k-mers, append them to the builder and emit
+    one tuple per super-k-mer into minimizers (either a minimizers_tuples or a
+    std::vector<minimizer_tuple>). Return the number of parsed k-mers.
+*/
+template <typename Minimizers>
+uint64_t parse_sequence(std::string_view sequence, compact_string_pool::builder& builder,
+                        Minimizers& minimizers, build_configuration const& build_config) {
     uint64_t k = build_config.k;
     uint64_t m = build_config.m;
     uint64_t seed = build_config.seed;
     uint64_t max_num_kmers_in_super_kmer = k - m + 1;
     uint64_t block_size = 2 * k - m;  // max_num_kmers_in_super_kmer + k - 1
 
-    if (max_num_kmers_in_super_kmer >= (1ULL << (sizeof(num_kmers_in_super_kmer_uint_type) * 8))) {
-        throw std::runtime_error(
-            "max_num_kmers_in_super_kmer " + std::to_string(max_num_kmers_in_super_kmer) +
-            " does not fit into " + std::to_string(sizeof(num_kmers_in_super_kmer_uint_type) * 8) +
-            " bits");
-    }
+    assert(sequence.size() >= k);
 
-    /* fit into the wanted number of bits */
-    assert(max_num_kmers_in_super_kmer < (1ULL << (sizeof(num_kmers_in_super_kmer_uint_type) * 8)));
-
-    compact_string_pool::builder builder(k);
-
-    std::string sequence;
     uint64_t prev_minimizer = constants::invalid_uint64;
-
     uint64_t begin = 0;  // begin of parsed super_kmer in sequence
     uint64_t end = 0;    // end of parsed super_kmer in sequence
-    uint64_t num_sequences = 0;
-    uint64_t num_bases = 0;
-    bool glue = false;
+    bool glue = false;   // start a new piece
 
     auto append_super_kmer = [&]() {
-        if (sequence.empty() or prev_minimizer == constants::invalid_uint64 or begin == end) {
-            return;
-        }
+        if (prev_minimizer == constants::invalid_uint64 or begin == end) return;
 
         assert(end > begin);
         char const* super_kmer = sequence.data() + begin;
@@ -60,27 +58,223 @@ void parse_file(std::istream& is, parse_data& data, build_configuration const& b
             if (i == num_blocks - 1) n = size;
             uint64_t num_kmers_in_block = n - k + 1;
             assert(num_kmers_in_block <= max_num_kmers_in_super_kmer);
-            data.minimizers.emplace_back(prev_minimizer, builder.offset, num_kmers_in_block);
+            minimizers.emplace_back(prev_minimizer, builder.offset, num_kmers_in_block);
             builder.append(super_kmer + i * max_num_kmers_in_super_kmer, n, glue);
             if (glue) {
-                assert(data.minimizers.back().offset > k - 1);
-                data.minimizers.back().offset -= k - 1;
+                assert(minimizers.back().offset > k - 1);
+                minimizers.back().offset -= k - 1;
             }
             size -= max_num_kmers_in_super_kmer;
             glue = true;
         }
     };
 
-    uint64_t seq_len = 0;
-    uint64_t sum_of_weights = 0;
-    data.weights_builder.init();
+    /* rolling minimizers: ~1 hash per k-mer instead of k - m + 1 */
+    minimizer_enumerator<> minimizer_enum(k, m, seed);
+    minimizer_enumerator<> minimizer_enum_rc(k, m, seed);
+    kmer_t uint_kmer = 0;
+
+    while (end != sequence.size() - k + 1) {
+        char const* kmer = sequence.data() + end;
+        assert(util::is_valid(kmer, k));
+        bool clear = end == 0;
+        if (clear) {
+            uint_kmer = util::string_to_uint_kmer_no_reverse(kmer, k);
+        } else {
+            uint_kmer >>= 2;
+            uint_kmer += static_cast<kmer_t>(util::char_to_uint(kmer[k - 1])) << (2 * (k - 1));
+        }
+        assert(uint_kmer == util::string_to_uint_kmer_no_reverse(kmer, k));
+        uint64_t minimizer = minimizer_enum.next(uint_kmer, clear);
+        assert(minimizer == util::compute_minimizer(uint_kmer, k, m, seed));
+
+        if (build_config.canonical_parsing) {
+            kmer_t uint_kmer_rc = util::compute_reverse_complement(uint_kmer, k);
+            constexpr bool reverse = true;
+            uint64_t minimizer_rc = minimizer_enum_rc.next<reverse>(uint_kmer_rc, clear);
+            assert(minimizer_rc == util::compute_minimizer(uint_kmer_rc, k, m, seed));
+            minimizer = std::min<uint64_t>(minimizer, minimizer_rc);
+        }
+
+        if (prev_minimizer == constants::invalid_uint64) prev_minimizer = minimizer;
+        if (minimizer != prev_minimizer) {
+            append_super_kmer();
+            begin = end;
+            prev_minimizer = minimizer;
+            glue = true;
+        }
+
+        ++end;
+    }
+
+    append_super_kmer();
+    return end;
+}
+
+/*
+    The super-k-mers computed by a thread for a block of consecutive sequences.
+    Offsets are relative to the beginning of the block.
+*/
+struct parsed_block {
+    parsed_block(uint64_t k) : num_kmers(0), builder(k) {}
+    uint64_t num_kmers;
+    compact_string_pool::builder builder;
+    std::vector<minimizer_tuple> minimizers;
+};
+
+/*
+    Parse the sequences returned by read_sequence(sequence), which returns false when the
+    input is exhausted, into the string pool and the minimizer tuples of data (the weights
+    are left to the caller). The view returned in sequence must stay valid until the next
+    call. With more than one thread, the sequences are parsed in blocks by concurrent threads.
+*/
+template <typename ReadSequence>
+void parse_sequences(ReadSequence read_sequence, parse_data& data,
+                     build_configuration const& build_config) {
+    uint64_t k = build_config.k;
+    uint64_t m = build_config.m;
+    uint64_t max_num_kmers_in_super_kmer = k - m + 1;
+    uint64_t num_threads = build_config.num_threads;
+
+    if (max_num_kmers_in_super_kmer >= (1ULL << (sizeof(num_kmers_in_super_kmer_uint_type) * 8))) {
+        throw std::runtime_error(
+            "max_num_kmers_in_super_kmer " + std::to_string(max_num_kmers_in_super_kmer) +
+            " does not fit into " + std::to_string(sizeof(num_kmers_in_super_kmer_uint_type) * 8) +
+            " bits");
+    }
+
+    /* fit into the wanted number of bits */
+    assert(max_num_kmers_in_super_kmer < (1ULL << (sizeof(num_kmers_in_super_kmer_uint_type) * 8)));
+
+    compact_string_pool::builder builder(k);
+    std::string_view sequence;
+
+    if (num_threads == 1) {
+        while (read_sequence(sequence)) {
+            data.num_kmers += parse_sequence(sequence, builder, data.minimizers, build_config);
+        }
+    } else {
+        /*
+            Read a block of sequences per thread, parse the blocks in parallel into
+            thread-local pools and tuples, then concatenate them in input order
+            shifting the offsets: the result is identical to the sequential one.
+        */
+        constexpr uint64_t max_block_size = 1ULL << 22;  // in bases
+        std::vector<std::vector<std::string>> blocks(num_threads);
+        std::vector<parsed_block> parsed(num_threads, parsed_block(k));
+        std::vector<std::thread> threads(num_threads);
+
+        bool eof = false;
+        while (!eof) {
+            uint64_t num_blocks = 0;
+            for (; num_blocks != num_threads and !eof; ++num_blocks) {
+                auto& block = blocks[num_blocks];
+                block.clear();
+                uint64_t block_size = 0;
+                while (block_size < max_block_size) {
+                    if (!read_sequence(sequence)) {
+                        eof = true;
+                        break;
+                    }
+                    block_size += sequence.size();
+                    block.emplace_back(sequence);
+                }
+            }
+
+            for (uint64_t t = 0; t != num_blocks; ++t) {
+                threads[t] = std::thread([&, t]() {
+                    parsed_block& p = parsed[t];
+                    p = parsed_block(k);
+                    for (auto const& s : blocks[t]) {
+                        p.num_kmers += parse_sequence(s, p.builder, p.minimizers, build_config);
+                    }
+                });
+            }
+
+            for (uint64_t t = 0; t != num_blocks; ++t) {
+                threads[t].join();
+                parsed_block const& p = parsed[t];
+                uint64_t base = builder.offset;
+                for (minimizer_tuple tuple : p.minimizers) {
+                    data.minimizers.emplace_back(tuple.minimizer, base + tuple.offset,
+                                                 tuple.num_kmers_in_super_kmer);
+                }
+                builder.append(p.builder);
+                data.num_kmers += p.num_kmers;
+            }
+        }
+    }
 
-    /* intervals of weights */
-    uint64_t weight_value = constants::invalid_uint64;
-    uint64_t weight_length = 0;
+    data.minimizers.finalize();
+    builder.finalize();
+    builder.build(data.strings);
+}
+
+/*
+    Accumulate the weights of consecutive k-mers into the intervals of equal weights
+    of a weights::builder.
+*/
+struct weight_intervals {
+    weight_intervals(weights::builder& builder)
+        : sum_of_weights(0)
+        , m_builder(builder)
+        , m_weight_value(constants::invalid_uint64)
+        , m_weight_length(0) {
+        m_builder.init();
+    }
+
+    void add(uint64_t weight) {
+        m_builder.eat(weight);
+        sum_of_weights += weight;
+        if (weight == m_weight_value) {
+            m_weight_length += 1;
+        } else {
+            if (m_weight_value != constants::invalid_uint64) {
+                m_builder.push_weight_interval(m_weight_value, m_weight_length);
+            }
+            m_weight_value = weight;
+            m_weight_length = 1;
+        }
+    }
+
+    void finalize(uint64_t num_kmers) {
+        m_builder.push_weight_interval(m_weight_value, m_weight_length);
+        m_builder.finalize(num_kmers);
+    }
+
+    uint64_t sum_of_weights;
+
+private:
+    weights::builder& m_builder;
+    uint64_t m_weight_value;
+    uint64_t m_weight_length;
+};
+
+void print_parse_info(parse_data const& data, uint64_t num_sequences, uint64_t num_bases,
+                      uint64_t k) {
+    std::cout << "read " << num_sequences << " sequences, " << num_bases << " bases, "
+              << data.num_kmers << " kmers" << std::endl;
+    std::cout << "num_kmers " << data.num_kmers << std::endl;
+    std::cout << "num_super_kmers " << data.strings.num_super_kmers() << std::endl;
+    std::cout << "num_pieces " << data.strings.pieces.size() << " (+"
+              << (2.0 * data.strings.pieces.size() * (k - 1)) / data.num_kmers << " [bits/kmer])"
+              << std::endl;
+    assert(data.strings.pieces.size() == num_sequences + 1);
+}
+
+void parse_file(std::istream& is, parse_data& data, build_configuration const& build_config) {
+    uint64_t k = build_config.k;
+
+    fastx_reader reader(is, false);
+    uint64_t num_sequences = 0;
+    uint64_t num_bases = 0;
+
+    uint64_t seq_len = 0;
+    weight_intervals weights(data.weights_builder);
 
     auto parse_header = [&]() {
-        if (sequence.empty()) return;
+        std::string const& header = reader.header();
+        if (header.empty()) return;
 
         /*
             Heder format:
@@ -91,117 +285,71 @@ void parse_file(std::istream& is, parse_data& data, build_configuration const& b
 
         // example header: '>12 LN:i:41 ab:Z:2 2 2 2 2 2 2 2 2 2 2'
 
-        expect(sequence[0], '>');
+        expect(header[0], '>');
         uint64_t i = 0;
-        i = sequence.find_first_of(' ', i);
+        i = header.find_first_of(' ', i);
         if (i == std::string::npos) throw parse_runtime_error();
 
         i += 1;
-        expect(sequence[i + 0], 'L');
-        expect(sequence[i + 1], 'N');
-        expect(sequence[i + 2], ':');
-        expect(sequence[i + 3], 'i');
-        expect(sequence[i + 4], ':');
+        expect(header[i + 0], 'L');
+        expect(header[i + 1], 'N');
+        expect(header[i + 2], ':');
+        expect(header[i + 3], 'i');
+        expect(header[i + 4], ':');
         i += 5;
-        uint64_t j = sequence.find_first_of(' ', i);
+        uint64_t j = header.find_first_of(' ', i);
         if (j == std::string::npos) throw parse_runtime_error();
 
-        seq_len = std::strtoull(sequence.data() + i, nullptr, 10);
+        seq_len = std::strtoull(header.data() + i, nullptr, 10);
         i = j + 1;
-        expect(sequence[i + 0], 'a');
-        expect(sequence[i + 1], 'b');
-        expect(sequence[i + 2], ':');
-        expect(sequence[i + 3], 'Z');
-        expect(sequence[i + 4], ':');
+        expect(header[i + 0], 'a');
+        expect(header[i + 1], 'b');
+        expect(header[i + 2], ':');
+        expect(header[i + 3], 'Z');
+        expect(header[i + 4], ':');
         i += 5;
 
         for (uint64_t j = 0; j != seq_len - k + 1; ++j) {
-            uint64_t weight = std::strtoull(sequence.data() + i, nullptr, 10);
-            i = sequence.find_first_of(' ', i) + 1;
-
-            data.weights_builder.eat(weight);
-            sum_of_weights += weight;
-
-            if (weight == weight_value) {
-                weight_length += 1;
-            } else {
-                if (weight_value != constants::invalid_uint64) {
-                    data.weights_builder.push_weight_interval(weight_value, weight_length);
-                }
-                weight_value = weight;
-                weight_length = 1;
-            }
+            uint64_t weight = std::strtoull(header.data() + i, nullptr, 10);
+            i = header.find_first_of(' ', i) + 1;
+            weights.add(weight);
         }
     };
 
-    while (!is.eof()) {
-        std::getline(is, sequence);  // header sequence
-        if (build_config.weighted) parse_header();
-
-        std::getline(is, sequence);  // DNA sequence
-        if (sequence.size() < k) continue;
-
-        if (++num_sequences % 100000 == 0) {
-            std::cout << "read " << num_sequences << " sequences, " << num_bases << " bases, "
-                      << data.num_kmers << " kmers" << std::endl;
-        }
-
-        begin = 0;
-        end = 0;
-        glue = false;  // start a new piece
-        prev_minimizer = constants::invalid_uint64;
-        num_bases += sequence.size();
-
-        if (build_config.weighted and seq_len != sequence.size()) {
-            std::cout << "ERROR: expected a sequence of length " << seq_len
-                      << " but got one of length " << sequence.size() << std::endl;
-            throw std::runtime_error("file is malformed");
-        }
-
-        while (end != sequence.size() - k + 1) {
-            char const* kmer = sequence.data() + end;
-            assert(util::is_valid(kmer, k));
-            kmer_t uint_kmer = util::string_to_uint_kmer_no_reverse(kmer, k);
-            uint64_t minimizer = util::compute_minimizer(uint_kmer, k, m, seed);
-
-            if (build_config.canonical_parsing) {
-                kmer_t uint_kmer_rc = util::compute_reverse_complement(uint_kmer, k);
-                uint64_t minimizer_rc = util::compute_minimizer(uint_kmer_rc, k, m, seed);
-                minimizer = std::min<uint64_t>(minimizer, minimizer_rc);
+    /*
+        Read the next DNA sequence of at least k bases into sequence,
+        parsing the headers (and weights) in file order.
+        Return false when the input is exhausted.
+    */
+    auto read_sequence = [&](std::string_view& sequence) {
+        while (reader.next()) {
+            if (build_config.weighted) parse_header();
+            sequence = reader.sequence();
+            if (sequence.size() < k) continue;
+
+            if (++num_sequences % 100000 == 0) {
+                std::cout << "read " << num_sequences << " sequences, " << num_bases << " bases, "
+                          << data.num_kmers << " kmers" << std::endl;
             }
+            num_bases += sequence.size();
 
-            if (prev_minimizer == constants::invalid_uint64) prev_minimizer = minimizer;
-            if (minimizer != prev_minimizer) {
-                append_super_kmer();
-                begin = end;
-                prev_minimizer = minimizer;
-                glue = true;
+            if (build_config.weighted and seq_len != sequence.size()) {
+                std::cout << "ERROR: expected a sequence of length " << seq_len
+                          << " but got one of length " << sequence.size() << std::endl;
+                throw std::runtime_error("file is malformed");
             }
 
-            ++data.num_kmers;
-            ++end;
+            return true;
         }
+        return false;
+    };
 
-        append_super_kmer();
-    }
-
-    data.minimizers.finalize();
-    builder.finalize();
-    builder.build(data.strings);
-
-    std::cout << "read " << num_sequences << " sequences, " << num_bases << " bases, "
-              << data.num_kmers << " kmers" << std::endl;
-    std::cout << "num_kmers " << data.num_kmers << std::endl;
-    std::cout << "num_super_kmers " << data.strings.num_super_kmers() << std::endl;
-    std::cout << "num_pieces " << data.strings.pieces.size() << " (+"
-              << (2.0 * data.strings.pieces.size() * (k - 1)) / data.num_kmers << " [bits/kmer])"
-              << std::endl;
-    assert(data.strings.pieces.size() == num_sequences + 1);
+    parse_sequences(read_sequence, data, build_config);
+    print_parse_info(data, num_sequences, num_bases, k);
 
     if (build_config.weighted) {
-        std::cout << "sum_of_weights " << sum_of_weights << std::endl;
-        data.weights_builder.push_weight_interval(weight_value, weight_length);
-        data.weights_builder.finalize(data.num_kmers);
+        std::cout << "sum_of_weights " << weights.sum_of_weights << std::endl;
+        weights.finalize(data.num_kmers);
     }
 }
 
@@ -209,9 +357,9 @@ parse_data parse_file(std::string const& filename, build_configuration const& bu
     std::ifstream is(filename.c_str());
     if (!is.good()) throw std::runtime_error("error in opening the file '" + filename + "'");
     std::cout << "reading file '" << filename << "'..." << std::endl;
-    parse_data data(build_config.tmp_dirname);
+    parse_data data(build_config);
     if (util::ends_with(filename, ".gz")) {
-        zip_istream zis(is);
+        threaded_zip_istream zis(filename, build_config.num_threads);
         parse_file(zis, data, build_config);
     } else {
         parse_file(is, data, build_config);
@@ -220,4 +368,4 @@ parse_data parse_file(std::string const& filename, build_configuration const& bu
     return data;
 }
 
-}  // namespace sshash
\ No newline at end of file
+}  // namespace sshash
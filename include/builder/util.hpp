@@ -1,5 +1,9 @@
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <thread>
+
 #include "file_merging_iterator.hpp"
 
 namespace sshash {
@@ -10,6 +14,68 @@ namespace sshash {
               << (time * 1000) / num_kmers << " [ns/kmer])" << std::endl;
 }
 
+/*
+    Sort [begin, end) with num_threads threads: sort one block per thread,
+    then merge adjacent blocks in parallel until a single block remains.
+*/
+template <typename RandomAccessIterator, typename Compare>
+void parallel_sort(RandomAccessIterator begin, RandomAccessIterator end, Compare comp,
+                   uint64_t num_threads) {
+    uint64_t n = std::distance(begin, end);
+    constexpr uint64_t min_block_size = 1ULL << 16;
+    if (num_threads <= 1 or n <= min_block_size) {
+        std::sort(begin, end, comp);
+        return;
+    }
+
+    uint64_t block_size = std::max<uint64_t>((n + num_threads - 1) / num_threads, min_block_size);
+    std::vector<uint64_t> bounds;
+    for (uint64_t i = 0; i < n; i += block_size) bounds.push_back(i);
+    bounds.push_back(n);
+
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i + 1 != bounds.size(); ++i) {
+        threads.emplace_back(
+            [&, i]() { std::sort(begin + bounds[i], begin + bounds[i + 1], comp); });
+    }
+    for (auto& t : threads) t.join();
+
+    while (bounds.size() > 2) {
+        threads.clear();
+        std::vector<uint64_t> merged_bounds;
+        uint64_t num_blocks = bounds.size() - 1;
+        for (uint64_t i = 0; i < num_blocks; i += 2) {
+            merged_bounds.push_back(bounds[i]);
+            if (i + 1 == num_blocks) break;
+            threads.emplace_back([&, i]() {
+                std::inplace_merge(begin + bounds[i], begin + bounds[i + 1], begin + bounds[i + 2],
+                                   comp);
+            });
+        }
+        merged_bounds.push_back(n);
+        for (auto& t : threads) t.join();
+        bounds.swap(merged_bounds);
+    }
+}
+
+/*
+    Set the i-th value of a zero-initialized compact_vector::builder with atomic
+    bitwise ORs, so that different threads can set different positions concurrently
+    (also when they share a word). Each position must be set at most once.
+*/
+inline void atomic_set(pthash::compact_vector::builder& cvb, uint64_t i, uint64_t v) {
+    uint64_t width = cvb.width();
+    assert(i < cvb.size());
+    assert(width == 64 or (v >> width) == 0);
+    uint64_t* bits = cvb.bits().data();
+    uint64_t pos = i * width;
+    uint64_t block = pos >> 6;
+    uint64_t shift = pos & 63;
+    __atomic_fetch_or(bits + block, v << shift, __ATOMIC_RELAXED);
+    uint64_t res_shift = 64 - shift;
+    if (res_shift < width) __atomic_fetch_or(bits + block + 1, v >> res_shift, __ATOMIC_RELAXED);
+}
+
 struct empty_bucket_runtime_error : public std::runtime_error {
     empty_bucket_runtime_error()
         : std::runtime_error("try a different choice of l or change seed") {}
@@ -55,6 +121,15 @@ struct compact_string_pool {
             offset = bvb_strings.size() / 2;
         }
 
+        /* Append all the pieces of another (not finalized) builder. */
+        void append(builder const& other) {
+            uint64_t base = bvb_strings.size() / 2;
+            for (uint64_t piece : other.pieces) pieces.push_back(base + piece);
+            bvb_strings.append(other.bvb_strings);
+            num_super_kmers += other.num_super_kmers;
+            offset = bvb_strings.size() / 2;
+        }
+
         void finalize() {
             /* So pieces will be of size p+1, where p is the number of DNA sequences
                in the input file. */
@@ -174,9 +249,9 @@ private:
 
     minimizer_tuple const* next_begin() {
         minimizer_tuple const* begin = m_list_begin;
+        if (begin == m_end) return begin;
         uint64_t prev_minimizer = (*begin).minimizer;
-        while (begin != m_end) {
-            ++begin;
+        while (++begin != m_end) {
             uint64_t curr_minimizer = (*begin).minimizer;
             if (curr_minimizer != prev_minimizer) break;
         }
@@ -198,15 +273,18 @@ private:
 };
 
 struct minimizers_tuples {
-    static constexpr uint64_t ram_limit = 0.5 * essentials::GB;
-
-    minimizers_tuples(std::string const& tmp_dirname)
+    minimizers_tuples(std::string const& tmp_dirname, uint64_t ram_limit, uint64_t num_threads = 1)
         : m_buffer_size(0)
         , m_num_files_to_merge(0)
         , m_num_minimizers(0)
+        , m_num_threads(num_threads)
+        , m_in_memory(false)
         , m_run_identifier(pthash::clock_type::now().time_since_epoch().count())
         , m_tmp_dirname(tmp_dirname) {
-        m_buffer_size = ram_limit / sizeof(minimizer_tuple);
+        m_buffer_size = std::max<uint64_t>(ram_limit / sizeof(minimizer_tuple), 1);
+        /* with more threads, a full buffer is sorted and written to disk in background
+           while the other is being filled: split the RAM between the two */
+        if (m_num_threads > 1 and m_buffer_size > 1) m_buffer_size /= 2;
         std::cout << "m_buffer_size " << m_buffer_size << std::endl;
     }
 
@@ -218,27 +296,30 @@ struct minimizers_tuples {
     minimizer_tuple& back() { return m_buffer.back(); }
 
     void sort_and_flush() {
-        std::cout << "sorting buffer..." << std::endl;
-        std::sort(m_buffer.begin(), m_buffer.end(),
-                  [](minimizer_tuple const& x, minimizer_tuple const& y) {
-                      return (x.minimizer < y.minimizer) or
-                             (x.minimizer == y.minimizer and x.offset < y.offset);
-                  });
-
-        auto tmp_output_filename = get_tmp_output_filename(m_num_files_to_merge);
-        std::cout << "saving to file '" << tmp_output_filename << "'..." << std::endl;
-        std::ofstream out(tmp_output_filename.c_str(), std::ofstream::binary);
-        if (!out.is_open()) throw std::runtime_error("util.hpp: 231 cannot open file " + tmp_output_filename);
-        out.write(reinterpret_cast<char const*>(m_buffer.data()),
-                  m_buffer.size() * sizeof(minimizer_tuple));
-        out.close();
-
-        m_buffer.clear();
+        if (m_num_threads == 1) {
+            sort_and_flush(m_buffer, m_num_files_to_merge);
+            m_buffer.clear();
+        } else {
+            wait_flush();
+            m_buffer.swap(m_flush_buffer);
+            m_flush = std::async(std::launch::async, [this, id = m_num_files_to_merge]() {
+                sort_and_flush(m_flush_buffer, id);
+                m_flush_buffer.clear();
+            });
+            m_buffer.clear();
+        }
         ++m_num_files_to_merge;
     }
 
     void finalize() {
+        if (m_num_files_to_merge == 0) {
+            /* all tuples fit into the buffer: keep them in memory, without tmp files */
+            sort(m_buffer);
+            m_in_memory = true;
+            return;
+        }
         if (!m_buffer.empty()) sort_and_flush();
+        wait_flush();
     }
 
     std::string get_minimizers_filename() const {
@@ -262,18 +343,20 @@ struct minimizers_tuples {
 
     files_name_iterator files_name_iterator_begin() { return files_name_iterator(this); }
 
+    /*
+        Merge the sorted runs. After this call, the sorted tuples are available
+        in [begin(), end()), either from memory or memory-mapped from disk.
+    */
     void merge() {
-        if (m_num_files_to_merge == 0) return;
+        if (m_in_memory) {
+            count_minimizers();
+            return;
+        }
 
         if (m_num_files_to_merge == 1) {
             /* just count num. distinct minimizers and do not write twice on disk */
-            mm::file_source<minimizer_tuple> input(get_minimizers_filename(),
-                                                   mm::advice::sequential);
-            for (minimizers_tuples_iterator it(input.data(), input.data() + input.size());
-                 it.has_next(); it.next()) {
-                ++m_num_minimizers;
-            }
-            input.close();
+            m_input.open(get_minimizers_filename(), mm::advice::sequential);
+            count_minimizers();
             return;
         }
 
@@ -289,12 +372,23 @@ struct minimizers_tuples {
             throw std::runtime_error("util.hpp: 289 cannot open file: " + get_minimizers_filename());
         }
 
+        /* write the merged tuples in large blocks */
+        constexpr uint64_t output_buffer_size = (8 * essentials::MB) / sizeof(minimizer_tuple);
+        std::vector<minimizer_tuple> output_buffer;
+        output_buffer.reserve(output_buffer_size);
+        auto flush_output_buffer = [&]() {
+            out.write(reinterpret_cast<char const*>(output_buffer.data()),
+                      output_buffer.size() * sizeof(minimizer_tuple));
+            output_buffer.clear();
+        };
+
         uint64_t num_written_tuples = 0;
         uint64_t prev_minimizer = constants::invalid_uint64;
         while (fm_iterator.has_next()) {
             auto file_it = *fm_iterator;
             minimizer_tuple tuple = *file_it;
-            out.write(reinterpret_cast<char const*>(&tuple), sizeof(minimizer_tuple));
+            output_buffer.push_back(tuple);
+            if (output_buffer.size() == output_buffer_size) flush_output_buffer();
             num_written_tuples += 1;
             if (tuple.minimizer != prev_minimizer) {
                 prev_minimizer = tuple.minimizer;
@@ -305,6 +399,7 @@ struct minimizers_tuples {
             }
             fm_iterator.next();
         }
+        flush_output_buffer();
         std::cout << "num_written_tuples = " << num_written_tuples << std::endl;
 
         out.close();
@@ -317,18 +412,74 @@ struct minimizers_tuples {
         }
 
         std::vector<minimizer_tuple>().swap(m_buffer);
+        std::vector<minimizer_tuple>().swap(m_flush_buffer);
+
+        m_input.open(get_minimizers_filename(), mm::advice::sequential);
+    }
+
+    minimizer_tuple const* begin() const {
+        return m_in_memory ? m_buffer.data() : m_input.data();
+    }
+    minimizer_tuple const* end() const {
+        return m_in_memory ? m_buffer.data() + m_buffer.size() : m_input.data() + m_input.size();
     }
 
     uint64_t num_minimizers() const { return m_num_minimizers; }
-    void remove_tmp_file() { std::remove(get_minimizers_filename().c_str()); }
+
+    void remove_tmp_file() {
+        if (m_in_memory) {
+            std::vector<minimizer_tuple>().swap(m_buffer);
+            return;
+        }
+        m_input.close();
+        std::remove(get_minimizers_filename().c_str());
+    }
 
 private:
     uint64_t m_buffer_size;
     uint64_t m_num_files_to_merge;
     uint64_t m_num_minimizers;
+    uint64_t m_num_threads;
+    bool m_in_memory;
     uint64_t m_run_identifier;
     std::string m_tmp_dirname;
     std::vector<minimizer_tuple> m_buffer;
+    std::vector<minimizer_tuple> m_flush_buffer;
+    std::future<void> m_flush;
+    mm::file_source<minimizer_tuple> m_input;
+
+    void sort(std::vector<minimizer_tuple>& buffer) const {
+        std::cout << "sorting buffer..." << std::endl;
+        parallel_sort(buffer.begin(), buffer.end(),
+                      [](minimizer_tuple const& x, minimizer_tuple const& y) {
+                          return (x.minimizer < y.minimizer) or
+                                 (x.minimizer == y.minimizer and x.offset < y.offset);
+                      },
+                      m_num_threads);
+    }
+
+    void sort_and_flush(std::vector<minimizer_tuple>& buffer, uint64_t id) const {
+        sort(buffer);
+
+        auto tmp_output_filename = get_tmp_output_filename(id);
+        std::cout << "saving to file '" << tmp_output_filename << "'..." << std::endl;
+        std::ofstream out(tmp_output_filename.c_str(), std::ofstream::binary);
+        if (!out.is_open()) throw std::runtime_error("cannot open file " + tmp_output_filename);
+        out.write(reinterpret_cast<char const*>(buffer.data()),
+                  buffer.size() * sizeof(minimizer_tuple));
+        out.close();
+    }
+
+    void count_minimizers() {
+        for (minimizers_tuples_iterator it(begin(), end()); it.has_next(); it.next()) {
+            ++m_num_minimizers;
+        }
+    }
+
+    /* wait for the background flush (if any) and rethrow its exceptions */
+    void wait_flush() {
+        if (m_flush.valid()) m_flush.get();
+    }
 
     std::string get_tmp_output_filename(uint64_t id) const {
         std::stringstream filename;
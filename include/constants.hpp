@@ -20,8 +20,15 @@ constexpr uint64_t seed = 1;
 constexpr double c = 3.0;  // for PTHash
 constexpr uint64_t min_l = 6;
 constexpr uint64_t max_l = 12;
+constexpr uint64_t cache_line_size = 64;  // in bytes
+constexpr uint64_t lookup_batch_size = 16;  // num. of in-flight queries in dictionary::lookup_batch
 static const std::string default_tmp_dirname(".");
+constexpr uint64_t default_ram = 2ULL * 1000 * 1000 * 1000;  // 2 GB, for construction
 constexpr bool forward_orientation = 0;
 constexpr bool backward_orientation = 1;
 
+/* header of a serialized index: "SSHASH" (little-endian) and the format version */
+constexpr uint64_t index_magic = 0x485341485353;
+constexpr uint64_t index_format_version = 2;
+
 }  // namespace sshash::constants
\ No newline at end of file
@@ -1,60 +1,239 @@
 #include "dictionary.hpp"
+#include "perf_counters.hpp"
 
 namespace sshash {
 
 lookup_result dictionary::lookup_uint_regular_parsing(kmer_t uint_kmer) const {
-    uint64_t minimizer = util::compute_minimizer(uint_kmer, m_k, m_m, m_seed);
-    uint64_t bucket_id = m_minimizers.lookup(minimizer);
-
-    if (m_skew_index.empty()) return m_buckets.lookup(bucket_id, uint_kmer, m_k, m_m);
-
-    auto [begin, end] = m_buckets.locate_bucket(bucket_id);
-    uint64_t num_super_kmers_in_bucket = end - begin;
-    uint64_t log2_bucket_size = util::ceil_log2_uint32(num_super_kmers_in_bucket);
-    if (log2_bucket_size > m_skew_index.min_log2) {
-        uint64_t pos = m_skew_index.lookup(uint_kmer, log2_bucket_size);
-        /* It must hold pos < num_super_kmers_in_bucket for the kmer to exist. */
-        if (pos < num_super_kmers_in_bucket) {
-            return m_buckets.lookup_in_super_kmer(begin + pos, uint_kmer, m_k, m_m);
-        }
-        return lookup_result();
+    if (!m_filter.contains(uint_kmer)) return lookup_result();
+    return lookup_uint_regular_parsing_unfiltered(uint_kmer);
+}
+
+/* As lookup_uint_regular_parsing, but without consulting the filter. */
+lookup_result dictionary::lookup_uint_regular_parsing_unfiltered(kmer_t uint_kmer) const {
+    uint64_t minimizer, bucket_id, begin, end;
+    {
+        SSHASH_PERF_SCOPE(minimizer);
+        minimizer = util::compute_minimizer(uint_kmer, m_k, m_m, m_seed);
+    }
+    {
+        SSHASH_PERF_SCOPE(mphf);
+        bucket_id = m_minimizers.lookup(minimizer);
     }
+    {
+        SSHASH_PERF_SCOPE(locate_bucket);
+        std::tie(begin, end) = m_buckets.locate_bucket(bucket_id);
+    }
+    return lookup_in_bucket_regular_parsing(begin, end, uint_kmer);
+}
 
+lookup_result dictionary::lookup_in_bucket_regular_parsing(uint64_t begin, uint64_t end,
+                                                           kmer_t uint_kmer) const {
+    if (!m_skew_index.empty()) {
+        uint64_t num_super_kmers_in_bucket = end - begin;
+        uint64_t log2_bucket_size = util::ceil_log2_uint32(num_super_kmers_in_bucket);
+        if (log2_bucket_size > m_skew_index.min_log2) {
+            uint64_t pos;
+            {
+                SSHASH_PERF_SCOPE(skew_index);
+                pos = m_skew_index.lookup(uint_kmer, log2_bucket_size);
+            }
+            /* It must hold pos < num_super_kmers_in_bucket for the kmer to exist. */
+            if (pos < num_super_kmers_in_bucket) {
+                SSHASH_PERF_SCOPE(super_kmer_scan);
+                return m_buckets.lookup_in_super_kmer(begin + pos, uint_kmer, m_k, m_m);
+            }
+            return lookup_result();
+        }
+    }
+    SSHASH_PERF_SCOPE(super_kmer_scan);
     return m_buckets.lookup(begin, end, uint_kmer, m_k, m_m);
 }
 
-lookup_result dictionary::lookup_uint_canonical_parsing(kmer_t uint_kmer) const {
+/*
+    Equivalent to looking up uint_kmer and, if it is not found, its reverse complement,
+    but the two minimizers are hashed together and the two buckets are located
+    (prefetching the first string of each) and scanned interleaved, so that the
+    cache misses of the two probes overlap.
+*/
+lookup_result dictionary::lookup_uint_regular_parsing_both_strands(kmer_t uint_kmer) const {
     kmer_t uint_kmer_rc = util::compute_reverse_complement(uint_kmer, m_k);
-    uint64_t minimizer = util::compute_minimizer(uint_kmer, m_k, m_m, m_seed);
-    uint64_t minimizer_rc = util::compute_minimizer(uint_kmer_rc, m_k, m_m, m_seed);
-    uint64_t bucket_id = m_minimizers.lookup(std::min<uint64_t>(minimizer, minimizer_rc));
 
-    if (m_skew_index.empty()) {
-        return m_buckets.lookup_canonical(bucket_id, uint_kmer, uint_kmer_rc, m_k, m_m);
+    if (!m_filter.empty()) {
+        bool forward = m_filter.contains(uint_kmer);
+        bool backward = m_filter.contains(uint_kmer_rc);
+        if (!backward) {
+            return forward ? lookup_uint_regular_parsing_unfiltered(uint_kmer) : lookup_result();
+        }
+        if (!forward) {
+            auto res = lookup_uint_regular_parsing_unfiltered(uint_kmer_rc);
+            res.kmer_orientation = constants::backward_orientation;
+            return res;
+        }
     }
 
-    auto [begin, end] = m_buckets.locate_bucket(bucket_id);
-    uint64_t num_super_kmers_in_bucket = end - begin;
-    uint64_t log2_bucket_size = util::ceil_log2_uint32(num_super_kmers_in_bucket);
-    if (log2_bucket_size > m_skew_index.min_log2) {
-        uint64_t pos = m_skew_index.lookup(uint_kmer, log2_bucket_size);
-        if (pos < num_super_kmers_in_bucket) {
-            auto res = m_buckets.lookup_in_super_kmer(begin + pos, uint_kmer, m_k, m_m);
-            assert(res.kmer_orientation == constants::forward_orientation);
+    uint64_t minimizer, minimizer_rc, bucket_id, bucket_id_rc, begin, end, begin_rc, end_rc;
+    {
+        SSHASH_PERF_SCOPE(minimizer);
+        minimizer = util::compute_minimizer(uint_kmer, m_k, m_m, m_seed);
+        minimizer_rc = util::compute_minimizer(uint_kmer_rc, m_k, m_m, m_seed);
+    }
+    {
+        SSHASH_PERF_SCOPE(mphf);
+        bucket_id = m_minimizers.lookup(minimizer);
+        bucket_id_rc = m_minimizers.lookup(minimizer_rc);
+    }
+    {
+        SSHASH_PERF_SCOPE(locate_bucket);
+        m_buckets.prefetch_bucket(bucket_id);
+        m_buckets.prefetch_bucket(bucket_id_rc);
+        std::tie(begin, end) = m_buckets.locate_bucket(bucket_id);
+        std::tie(begin_rc, end_rc) = m_buckets.locate_bucket(bucket_id_rc);
+        m_buckets.prefetch_offset(begin);
+        m_buckets.prefetch_offset(begin_rc);
+        m_buckets.prefetch_string(m_buckets.offsets.access(begin));
+        m_buckets.prefetch_string(m_buckets.offsets.access(begin_rc));
+    }
+
+    if (!m_skew_index.empty()) {
+        /* a bucket served by the skew index costs a single super-k-mer scan */
+        uint64_t log2_bucket_size = util::ceil_log2_uint32(end - begin);
+        uint64_t log2_bucket_size_rc = util::ceil_log2_uint32(end_rc - begin_rc);
+        if (log2_bucket_size > m_skew_index.min_log2 or
+            log2_bucket_size_rc > m_skew_index.min_log2) {
+            auto res = lookup_in_bucket_regular_parsing(begin, end, uint_kmer);
             if (res.kmer_id != constants::invalid_uint64) return res;
-        }
-        uint64_t pos_rc = m_skew_index.lookup(uint_kmer_rc, log2_bucket_size);
-        if (pos_rc < num_super_kmers_in_bucket) {
-            auto res = m_buckets.lookup_in_super_kmer(begin + pos_rc, uint_kmer_rc, m_k, m_m);
+            res = lookup_in_bucket_regular_parsing(begin_rc, end_rc, uint_kmer_rc);
             res.kmer_orientation = constants::backward_orientation;
             return res;
         }
-        return lookup_result();
     }
 
+    SSHASH_PERF_SCOPE(super_kmer_scan);
+    return m_buckets.lookup_both_strands(begin, end, begin_rc, end_rc, uint_kmer, uint_kmer_rc,
+                                         m_k, m_m);
+}
+
+lookup_result dictionary::lookup_uint_canonical_parsing(kmer_t uint_kmer) const {
+    kmer_t uint_kmer_rc = util::compute_reverse_complement(uint_kmer, m_k);
+    if (!m_filter.contains(std::min(uint_kmer, uint_kmer_rc))) return lookup_result();
+    uint64_t minimizer, bucket_id, begin, end;
+    {
+        SSHASH_PERF_SCOPE(minimizer);
+        minimizer = std::min<uint64_t>(util::compute_minimizer(uint_kmer, m_k, m_m, m_seed),
+                                       util::compute_minimizer(uint_kmer_rc, m_k, m_m, m_seed));
+    }
+    {
+        SSHASH_PERF_SCOPE(mphf);
+        bucket_id = m_minimizers.lookup(minimizer);
+    }
+    {
+        SSHASH_PERF_SCOPE(locate_bucket);
+        std::tie(begin, end) = m_buckets.locate_bucket(bucket_id);
+    }
+    return lookup_in_bucket_canonical_parsing(begin, end, uint_kmer, uint_kmer_rc);
+}
+
+lookup_result dictionary::lookup_in_bucket_canonical_parsing(uint64_t begin, uint64_t end,
+                                                             kmer_t uint_kmer,
+                                                             kmer_t uint_kmer_rc) const {
+    if (!m_skew_index.empty()) {
+        uint64_t num_super_kmers_in_bucket = end - begin;
+        uint64_t log2_bucket_size = util::ceil_log2_uint32(num_super_kmers_in_bucket);
+        if (log2_bucket_size > m_skew_index.min_log2) {
+            uint64_t pos, pos_rc;
+            {
+                SSHASH_PERF_SCOPE(skew_index);
+                pos = m_skew_index.lookup(uint_kmer, log2_bucket_size);
+            }
+            if (pos < num_super_kmers_in_bucket) {
+                SSHASH_PERF_SCOPE(super_kmer_scan);
+                auto res = m_buckets.lookup_in_super_kmer(begin + pos, uint_kmer, m_k, m_m);
+                assert(res.kmer_orientation == constants::forward_orientation);
+                if (res.kmer_id != constants::invalid_uint64) return res;
+            }
+            {
+                SSHASH_PERF_SCOPE(skew_index);
+                pos_rc = m_skew_index.lookup(uint_kmer_rc, log2_bucket_size);
+            }
+            if (pos_rc < num_super_kmers_in_bucket) {
+                SSHASH_PERF_SCOPE(super_kmer_scan);
+                auto res = m_buckets.lookup_in_super_kmer(begin + pos_rc, uint_kmer_rc, m_k, m_m);
+                res.kmer_orientation = constants::backward_orientation;
+                return res;
+            }
+            return lookup_result();
+        }
+    }
+    SSHASH_PERF_SCOPE(super_kmer_scan);
     return m_buckets.lookup_canonical(begin, end, uint_kmer, uint_kmer_rc, m_k, m_m);
 }
 
+/*
+    Resolve n <= constants::lookup_batch_size kmers stage by stage rather than one
+    kmer at a time: each stage issues independent memory accesses (and prefetches
+    the data needed by the next stage), so the cache misses of the n kmers overlap.
+*/
+template <bool canonical_parsing>
+void dictionary::lookup_batch_uint(kmer_t const* uint_kmers, uint64_t n,
+                                   lookup_result* out) const {
+    assert(n <= constants::lookup_batch_size);
+    uint64_t bucket_ids[constants::lookup_batch_size];
+    uint64_t begins[constants::lookup_batch_size];
+    uint64_t ends[constants::lookup_batch_size];
+    kmer_t uint_kmers_rc[constants::lookup_batch_size];
+
+    /* stage 0: compute the k-mers to check against the filter and prefetch their blocks */
+    kmer_t filter_kmers[constants::lookup_batch_size];
+    for (uint64_t i = 0; i != n; ++i) {
+        filter_kmers[i] = uint_kmers[i];
+        if constexpr (canonical_parsing) {
+            uint_kmers_rc[i] = util::compute_reverse_complement(uint_kmers[i], m_k);
+            filter_kmers[i] = std::min(uint_kmers[i], uint_kmers_rc[i]);
+        }
+        m_filter.prefetch(filter_kmers[i]);
+    }
+
+    /* stage 1: hash the minimizers and evaluate the MPHF (for the k-mers passing the filter) */
+    for (uint64_t i = 0; i != n; ++i) {
+        if (!m_filter.contains(filter_kmers[i])) {
+            bucket_ids[i] = constants::invalid_uint64;
+            continue;
+        }
+        uint64_t minimizer = util::compute_minimizer(uint_kmers[i], m_k, m_m, m_seed);
+        if constexpr (canonical_parsing) {
+            uint64_t minimizer_rc = util::compute_minimizer(uint_kmers_rc[i], m_k, m_m, m_seed);
+            minimizer = std::min<uint64_t>(minimizer, minimizer_rc);
+        }
+        bucket_ids[i] = m_minimizers.lookup(minimizer);
+        m_buckets.prefetch_bucket(bucket_ids[i]);
+    }
+
+    /* stage 2: locate the buckets */
+    for (uint64_t i = 0; i != n; ++i) {
+        if (bucket_ids[i] == constants::invalid_uint64) continue;
+        std::tie(begins[i], ends[i]) = m_buckets.locate_bucket(bucket_ids[i]);
+        m_buckets.prefetch_offset(begins[i]);
+    }
+
+    /* stage 3: read the offset of the first super-k-mer of each bucket */
+    for (uint64_t i = 0; i != n; ++i) {
+        if (bucket_ids[i] == constants::invalid_uint64) continue;
+        m_buckets.prefetch_string(m_buckets.offsets.access(begins[i]));
+    }
+
+    /* stage 4: scan the buckets */
+    for (uint64_t i = 0; i != n; ++i) {
+        if (bucket_ids[i] == constants::invalid_uint64) {
+            out[i] = lookup_result();
+        } else if constexpr (canonical_parsing) {
+            out[i] = lookup_in_bucket_canonical_parsing(begins[i], ends[i], uint_kmers[i],
+                                                        uint_kmers_rc[i]);
+        } else {
+            out[i] = lookup_in_bucket_regular_parsing(begins[i], ends[i], uint_kmers[i]);
+        }
+    }
+}
+
 uint64_t dictionary::lookup(char const* string_kmer, bool check_reverse_complement) const {
     kmer_t uint_kmer = util::string_to_uint_kmer_no_reverse(string_kmer, m_k);
     return lookup_uint(uint_kmer, check_reverse_complement);
@@ -72,16 +251,44 @@ lookup_result dictionary::lookup_advanced(char const* string_kmer,
 lookup_result dictionary::lookup_advanced_uint(kmer_t uint_kmer,
                                                bool check_reverse_complement) const {
     if (m_canonical_parsing) return lookup_uint_canonical_parsing(uint_kmer);
+    if (check_reverse_complement) return lookup_uint_regular_parsing_both_strands(uint_kmer);
     auto res = lookup_uint_regular_parsing(uint_kmer);
     assert(res.kmer_orientation == constants::forward_orientation);
-    if (check_reverse_complement and res.kmer_id == constants::invalid_uint64) {
-        kmer_t uint_kmer_rc = util::compute_reverse_complement(uint_kmer, m_k);
-        res = lookup_uint_regular_parsing(uint_kmer_rc);
-        res.kmer_orientation = constants::backward_orientation;
-    }
     return res;
 }
 
+void dictionary::lookup_batch(kmer_t const* uint_kmers, uint64_t n, lookup_result* out,
+                              bool check_reverse_complement) const {
+    constexpr uint64_t batch_size = constants::lookup_batch_size;
+    for (uint64_t i = 0; i < n; i += batch_size) {
+        uint64_t size = std::min<uint64_t>(batch_size, n - i);
+        if (m_canonical_parsing) {
+            lookup_batch_uint<true>(uint_kmers + i, size, out + i);
+            continue;
+        }
+        lookup_batch_uint<false>(uint_kmers + i, size, out + i);
+        if (!check_reverse_complement) continue;
+
+        /* search the reverse complements of the missed kmers, again as a batch */
+        uint64_t num_misses = 0;
+        uint64_t misses[batch_size];
+        kmer_t misses_rc[batch_size];
+        for (uint64_t j = i; j != i + size; ++j) {
+            assert(out[j].kmer_orientation == constants::forward_orientation);
+            if (out[j].kmer_id != constants::invalid_uint64) continue;
+            misses[num_misses] = j;
+            misses_rc[num_misses] = util::compute_reverse_complement(uint_kmers[j], m_k);
+            ++num_misses;
+        }
+        lookup_result res[batch_size];
+        lookup_batch_uint<false>(misses_rc, num_misses, res);
+        for (uint64_t j = 0; j != num_misses; ++j) {
+            res[j].kmer_orientation = constants::backward_orientation;
+            out[misses[j]] = res[j];
+        }
+    }
+}
+
 bool dictionary::is_member(char const* string_kmer, bool check_reverse_complement) const {
     return lookup(string_kmer, check_reverse_complement) != constants::invalid_uint64;
 }
@@ -99,6 +306,56 @@ uint64_t dictionary::weight(uint64_t kmer_id) const {
     return m_weights.weight(kmer_id);
 }
 
+uint64_t dictionary::bucket_class(kmer_t uint_kmer, bool check_reverse_complement) const {
+    auto minimizer_class = [&](uint64_t minimizer) -> uint64_t {
+        auto [begin, end] = m_buckets.locate_bucket(m_minimizers.lookup(minimizer));
+        uint64_t num_super_kmers_in_bucket = end - begin;
+        if (num_super_kmers_in_bucket == 1) return 0;
+        if (!m_skew_index.empty()) {
+            uint64_t log2_bucket_size = util::ceil_log2_uint32(num_super_kmers_in_bucket);
+            if (log2_bucket_size > m_skew_index.min_log2) {
+                return 2 + m_skew_index.partition(log2_bucket_size);
+            }
+        }
+        return 1;
+    };
+    uint64_t minimizer = util::compute_minimizer(uint_kmer, m_k, m_m, m_seed);
+    if (!m_canonical_parsing and !check_reverse_complement) return minimizer_class(minimizer);
+    kmer_t uint_kmer_rc = util::compute_reverse_complement(uint_kmer, m_k);
+    uint64_t minimizer_rc = util::compute_minimizer(uint_kmer_rc, m_k, m_m, m_seed);
+    if (m_canonical_parsing) return minimizer_class(std::min<uint64_t>(minimizer, minimizer_rc));
+    /* both buckets are probed: the costlier one dominates */
+    return std::max(minimizer_class(minimizer), minimizer_class(minimizer_rc));
+}
+
+std::vector<contig_range> dictionary::partition(uint64_t num_ranges) const {
+    assert(num_ranges > 0);
+    std::vector<contig_range> ranges;
+    uint64_t contig_begin = 0;
+    uint64_t kmer_begin = 0;
+    for (uint64_t i = 1; i <= num_ranges and contig_begin != num_contigs(); ++i) {
+        uint64_t contig_end = num_contigs();
+        uint64_t kmer_end = size();
+        if (i != num_ranges) {
+            /* end the range at the first contig beginning at or after the target k-mer */
+            uint64_t target = (i * size()) / num_ranges;
+            if (target <= kmer_begin) continue;
+            contig_end = m_buckets.id_to_contig(target);
+            kmer_end = m_buckets.num_kmers_before_contig.access(contig_end);
+            if (kmer_end != target) {
+                contig_end += 1;
+                kmer_end = m_buckets.num_kmers_before_contig.access(contig_end);
+            }
+        }
+        assert(contig_end > contig_begin and kmer_end > kmer_begin);
+        ranges.push_back({contig_begin, contig_end, kmer_begin, kmer_end});
+        contig_begin = contig_end;
+        kmer_begin = kmer_end;
+    }
+    assert(kmer_begin == size());
+    return ranges;
+}
+
 uint64_t dictionary::contig_size(uint64_t contig_id) const {
     assert(contig_id < num_contigs());
     uint64_t contig_length = m_buckets.contig_length(contig_id);
@@ -168,7 +425,7 @@ uint64_t dictionary::num_bits() const {
     return 8 * (sizeof(m_size) + sizeof(m_seed) + sizeof(m_k) + sizeof(m_m) +
                 sizeof(m_canonical_parsing)) +
            m_minimizers.num_bits() + m_buckets.num_bits() + m_skew_index.num_bits() +
-           m_weights.num_bits();
+           m_weights.num_bits() + m_filter.num_bits();
 }
 
 }  // namespace sshash
\ No newline at end of file
@@ -5,15 +5,23 @@
 #include "buckets.hpp"
 #include "skew_index.hpp"
 #include "weights.hpp"
+#include "kmer_filter.hpp"
 
 namespace sshash {
 
+struct parse_data;
+
 struct dictionary {
     dictionary() : m_size(0), m_seed(0), m_k(0), m_m(0), m_canonical_parsing(0) {}
 
     /* Build from input file. */
     void build(std::string const& input_filename, build_configuration const& build_config);
 
+    /* Build the union of two dictionaries with the same k, m, seed and parsing, from
+       their contigs: the k-mers of a keep their ids, followed by the k-mers of b that
+       are not in a. If weighted, a shared k-mer keeps its weight in a. */
+    void merge(dictionary const& a, dictionary const& b, build_configuration const& build_config);
+
     /* Write super-k-mers to output file in FASTA format. */
     void dump(std::string const& output_filename) const;
 
@@ -21,6 +29,8 @@ struct dictionary {
     uint64_t seed() const { return m_seed; }
     uint64_t k() const { return m_k; }
     uint64_t m() const { return m_m; }
+    uint64_t l() const { return m_skew_index.min_log2; }
+    double c() const { return m_skew_index.c; }
     uint64_t num_contigs() const { return m_buckets.pieces.size() - 1; }
     bool canonicalized() const { return m_canonical_parsing; }
     bool weighted() const { return !m_weights.empty(); }
@@ -35,6 +45,19 @@ struct dictionary {
     lookup_result lookup_advanced_uint(kmer_t uint_kmer,
                                        bool check_reverse_complement = true) const;
 
+    /* Batched lookup queries: out[i] = lookup_advanced_uint(uint_kmers[i]), for i in [0,n).
+       Queries are processed in groups of constants::lookup_batch_size so that the cache misses
+       of different queries overlap. */
+    void lookup_batch(kmer_t const* uint_kmers, uint64_t n, lookup_result* out,
+                      bool check_reverse_complement = true) const;
+
+    /* Return the class of the bucket that uint_kmer is looked up in (for canonical parsing,
+       the same for both strands): 0 for a singleton bucket, 1 for a bucket that is scanned
+       linearly, and 2 + i for a bucket served by partition i of the skew index.
+       For regular parsing with check_reverse_complement, the buckets of both strands are
+       probed and the larger of their classes is returned (the filter is not consulted). */
+    uint64_t bucket_class(kmer_t uint_kmer, bool check_reverse_complement = true) const;
+
     /* Return the number of kmers in contig. Since contigs do not have duplicates,
        the length of the contig is always size + k - 1. */
     uint64_t contig_size(uint64_t contig_id) const;
@@ -64,7 +87,13 @@ struct dictionary {
     friend struct streaming_query_canonical_parsing;
     friend struct streaming_query_regular_parsing;
     streaming_query_report streaming_query_from_file(std::string const& filename,
-                                                     bool multiline) const;
+                                                     bool multiline,
+                                                     uint64_t num_threads = 1) const;
+    /* Also write a summary of every read to out, in input order:
+       see read_result in query/streaming_query.hpp for the TSV and binary formats. */
+    streaming_query_report streaming_query_from_file(std::string const& filename,
+                                                     bool multiline, uint64_t num_threads,
+                                                     std::ostream* out, bool binary) const;
 
     struct iterator {
         iterator(dictionary const* ptr, uint64_t kmer_id = 0) {
@@ -85,6 +114,56 @@ struct dictionary {
         return iterator(this, kmer_id);
     }
 
+    /* As iterator, but yield (kmer_id, uint_kmer) pairs, without building strings. */
+    struct uint_iterator {
+        uint_iterator(dictionary const* ptr, uint64_t kmer_id = 0) {
+            it = ptr->m_buckets.at_uint(kmer_id, ptr->m_k, ptr->m_size);
+        }
+
+        bool has_next() const { return it.has_next(); }
+        std::pair<uint64_t, kmer_t> next() { return it.next(); }
+
+    private:
+        typename buckets::uint_iterator it;
+    };
+
+    uint_iterator begin_uint() const { return uint_iterator(this); }
+
+    uint_iterator at_uint(uint64_t kmer_id) const {
+        assert(kmer_id < size());
+        return uint_iterator(this, kmer_id);
+    }
+
+    /* Iterate over the contigs as spans of strings() (see contig_span). */
+    typename buckets::contig_iterator begin_contigs() const { return m_buckets.contig_at(0, m_k); }
+
+    /* Call f(kmer_id, uint_kmer) for every k-mer of the dictionary, in order of kmer_id. */
+    template <typename Func>
+    void for_each_kmer(Func f) const {
+        m_buckets.for_each_kmer(0, num_contigs(), m_k, f);
+    }
+
+    /* Split the k-mers into at most num_ranges ranges of whole contigs, with about the
+       same number of k-mers each. The ranges can be scanned independently, e.g., with
+       at(range.kmer_begin), at_uint(range.kmer_begin), or for_each_kmer(range, f). */
+    std::vector<contig_range> partition(uint64_t num_ranges) const;
+
+    /* Call f(kmer_id, uint_kmer) for every k-mer of the range, in order of kmer_id. */
+    template <typename Func>
+    void for_each_kmer(contig_range const& range, Func f) const {
+        m_buckets.for_each_kmer(range.contig_begin, range.contig_end, m_k, f);
+    }
+
+    /* As for_each_kmer(f), but with num_threads threads: f is called concurrently (for
+       different k-mers), and in order of kmer_id within each range of partition(). */
+    template <typename Func>
+    void parallel_for_each_kmer(uint64_t num_threads, Func f) const {
+        /* more ranges than threads, to balance the load when contigs have very different sizes */
+        auto ranges = partition(num_threads > 1 ? 4 * num_threads : 1);
+        parallel_for(ranges.size(), num_threads,
+                     [&](uint64_t i) { for_each_kmer(ranges[i], f); });
+    }
+
     pthash::bit_vector const& strings() const { return m_buckets.strings; }
 
     uint64_t num_bits() const;
@@ -92,8 +171,36 @@ struct dictionary {
     void print_space_breakdown() const;
     void compute_statistics() const;
 
+    /*
+        The index begins with a header (see constants::index_magic), checked when loading.
+        The optional structures are preceded by a presence flag.
+    */
     template <typename Visitor>
     void visit(Visitor& visitor) {
+        uint64_t magic = constants::index_magic;
+        uint64_t version = constants::index_format_version;
+        uint64_t kmer_bits = constants::uint_kmer_bits;
+        visitor.visit(magic);
+        visitor.visit(version);
+        visitor.visit(kmer_bits);
+        if (magic != constants::index_magic) {
+            throw std::runtime_error(
+                "not an SSHash index of format version " +
+                std::to_string(constants::index_format_version) +
+                ": an index built before the format was versioned (version 2) cannot be "
+                "loaded and must be rebuilt with 'sshash build'");
+        }
+        if (version != constants::index_format_version) {
+            throw std::runtime_error("index format version " + std::to_string(version) +
+                                     " is not supported (expected version " +
+                                     std::to_string(constants::index_format_version) +
+                                     "): the index must be rebuilt with 'sshash build'");
+        }
+        if (kmer_bits != constants::uint_kmer_bits) {
+            throw std::runtime_error("the index was built with " + std::to_string(kmer_bits) +
+                                     "-bit k-mers, but this program uses " +
+                                     std::to_string(constants::uint_kmer_bits) + "-bit k-mers");
+        }
         visitor.visit(m_size);
         visitor.visit(m_seed);
         visitor.visit(m_k);
@@ -103,6 +210,9 @@ struct dictionary {
         visitor.visit(m_buckets);
         visitor.visit(m_skew_index);
         visitor.visit(m_weights);
+        uint8_t has_filter = !m_filter.empty();
+        visitor.visit(has_filter);
+        if (has_filter) visitor.visit(m_filter);
     }
 
 private:
@@ -115,9 +225,20 @@ private:
     buckets m_buckets;
     skew_index m_skew_index;
     weights m_weights;
+    kmer_filter m_filter;
 
+    void build(parse_data& data, build_configuration const& build_config,
+               std::vector<double>& timings);
     lookup_result lookup_uint_regular_parsing(kmer_t uint_kmer) const;
+    lookup_result lookup_uint_regular_parsing_unfiltered(kmer_t uint_kmer) const;
+    lookup_result lookup_uint_regular_parsing_both_strands(kmer_t uint_kmer) const;
     lookup_result lookup_uint_canonical_parsing(kmer_t uint_kmer) const;
+    lookup_result lookup_in_bucket_regular_parsing(uint64_t begin, uint64_t end,
+                                                   kmer_t uint_kmer) const;
+    lookup_result lookup_in_bucket_canonical_parsing(uint64_t begin, uint64_t end,
+                                                     kmer_t uint_kmer, kmer_t uint_kmer_rc) const;
+    template <bool canonical_parsing>
+    void lookup_batch_uint(kmer_t const* uint_kmers, uint64_t n, lookup_result* out) const;
     void forward_neighbours(kmer_t suffix, neighbourhood& res) const;
     void backward_neighbours(kmer_t prefix, neighbourhood& res) const;
 };
@@ -1,11 +1,12 @@
 #include "dictionary.hpp"
+#include "minimizer_enumerator.hpp"
 
 namespace sshash {
 
 void dictionary::dump(std::string const& filename) const {
     uint64_t num_kmers = size();
     uint64_t num_minimizers = m_minimizers.size();
-    uint64_t num_super_kmers = m_buckets.offsets.size();
+    uint64_t num_super_kmers = m_buckets.num_super_kmers();
 
     std::ofstream out(filename);
     std::cout << "dumping super-k-mers to file '" << filename << "'..." << std::endl;
@@ -18,6 +19,9 @@ void dictionary::dump(std::string const& filename) const {
     out << '>' << m_k << ':' << m_m << ':' << num_kmers << ':' << num_minimizers << ':'
         << num_super_kmers << "\nN\n";
 
+    minimizer_enumerator<> minimizer_enum(m_k, m_m, m_seed);
+    minimizer_enumerator<> minimizer_enum_rc(m_k, m_m, m_seed);
+
     for (uint64_t bucket_id = 0; bucket_id != num_minimizers; ++bucket_id) {
         auto [begin, end] = m_buckets.locate_bucket(bucket_id);
         for (uint64_t super_kmer_id = begin; super_kmer_id != end; ++super_kmer_id) {
@@ -30,14 +34,19 @@ void dictionary::dump(std::string const& filename) const {
             bool super_kmer_header_written = false;
             for (uint64_t w = 0; w != window_size; ++w) {
                 kmer_t kmer = bv_it.read_and_advance_by_two(2 * m_k);
-                auto [minimizer, pos] = util::compute_minimizer_pos(kmer, m_k, m_m, m_seed);
+                uint64_t minimizer = minimizer_enum.next(kmer, w == 0);
+                uint64_t pos = minimizer_enum.position();
+                assert(std::make_pair(minimizer, pos) ==
+                       util::compute_minimizer_pos(kmer, m_k, m_m, m_seed));
                 if (m_canonical_parsing) {
                     kmer_t kmer_rc = util::compute_reverse_complement(kmer, m_k);
-                    auto [minimizer_rc, pos_rc] =
-                        util::compute_minimizer_pos(kmer_rc, m_k, m_m, m_seed);
+                    constexpr bool reverse = true;
+                    uint64_t minimizer_rc = minimizer_enum_rc.next<reverse>(kmer_rc, w == 0);
+                    assert(std::make_pair(minimizer_rc, minimizer_enum_rc.position<reverse>()) ==
+                           util::compute_minimizer_pos(kmer_rc, m_k, m_m, m_seed));
                     if (minimizer_rc < minimizer) {
                         minimizer = minimizer_rc;
-                        pos = pos_rc;
+                        pos = minimizer_enum_rc.position<reverse>();
                     }
                 }
                 if (!super_kmer_header_written) {
@@ -85,6 +85,12 @@ struct ef_sequence {
                m_low_bits.access(i);
     }
 
+    /* Bring into cache the low bits of the i-th element. */
+    inline void prefetch(uint64_t i) const {
+        assert(i < size());
+        __builtin_prefetch(m_low_bits.bits().data() + ((i * m_low_bits.width()) >> 6));
+    }
+
     // inline uint64_t diff(uint64_t i) const {
     //     assert(i < size() && encode_prefix_sum);
     //     uint64_t low1 = m_low_bits.access(i);
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstring>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sshash {
+
+/*
+    Split a std::istream into lines reading it in large blocks (one virtual call per
+    block instead of per line) and searching the line ends with memchr.
+*/
+struct line_reader {
+    static constexpr uint64_t default_buffer_size = 1ULL << 20;
+
+    line_reader(std::istream& is, uint64_t buffer_size = default_buffer_size)
+        : m_is(is), m_buffer(buffer_size + 1, '\0'), m_begin(0), m_end(0), m_eof(false) {}
+
+    /*
+        Set line to the next line (without the trailing '\n') and return true,
+        or return false if the input is exhausted. The line points into the internal
+        buffer: it is valid until the next call and it is followed by either '\n' or '\0'.
+    */
+    bool next(std::string_view& line) {
+        while (true) {
+            char* begin = m_buffer.data() + m_begin;
+            char* end = static_cast<char*>(std::memchr(begin, '\n', m_end - m_begin));
+            if (end != nullptr) {
+                line = std::string_view(begin, end - begin);
+                m_begin += line.size() + 1;
+                return true;
+            }
+            if (m_eof) {
+                if (m_begin == m_end) return false;
+                line = std::string_view(begin, m_end - m_begin);  // last line, without '\n'
+                m_begin = m_end;
+                return true;
+            }
+            fill();
+        }
+    }
+
+private:
+    std::istream& m_is;
+    std::vector<char> m_buffer;  // one extra byte for the '\0' past the data
+    uint64_t m_begin, m_end;     // unread data is in [m_begin, m_end)
+    bool m_eof;
+
+    /* Move the unread data to the front, growing the buffer if a line does not fit. */
+    void fill() {
+        uint64_t size = m_end - m_begin;
+        std::memmove(m_buffer.data(), m_buffer.data() + m_begin, size);
+        m_begin = 0;
+        m_end = size;
+        if (m_end + 1 == m_buffer.size()) m_buffer.resize(2 * m_buffer.size());
+        m_is.read(m_buffer.data() + m_end, m_buffer.size() - 1 - m_end);
+        m_end += m_is.gcount();
+        if (!m_is) m_eof = true;
+        m_buffer[m_end] = '\0';
+    }
+};
+
+/*
+    Read FASTA/FASTQ records.
+    - FASTA: a header line followed by one sequence line.
+    - FASTQ: four lines per record (header, sequence, '+', quality).
+    - Multi-line FASTA: a record spans all the lines between two headers ('>').
+    The header is returned as a whole line (including '>' or '@'). The sequence points
+    into the buffer of the line_reader (or, for multi-line FASTA, into an internal
+    string) and is valid until the next call to next().
+*/
+struct fastx_reader {
+    fastx_reader(std::istream& is, bool fastq, bool multiline = false)
+        : m_lines(is)
+        , m_fastq(fastq)
+        , m_multiline(multiline)
+        , m_skip_quality(false)
+        , m_open_record(false) {}
+
+    /* Read the next record: return false if no record is left. */
+    bool next() {
+        if (m_multiline) return next_multiline();
+        std::string_view line;
+        if (m_skip_quality) {  // done here not to invalidate the previous sequence
+            m_lines.next(line);  // skip '+'
+            m_lines.next(line);  // skip quality
+            m_skip_quality = false;
+        }
+        if (!m_lines.next(line)) return false;
+        m_header.assign(line);
+        if (!m_lines.next(m_sequence)) m_sequence = std::string_view();
+        m_skip_quality = m_fastq;
+        return true;
+    }
+
+    std::string const& header() const { return m_header; }
+    std::string_view sequence() const { return m_sequence; }
+
+private:
+    line_reader m_lines;
+    bool m_fastq;
+    bool m_multiline;
+    bool m_skip_quality;
+    bool m_open_record;  // the header of the next record was already read into m_next_header
+    std::string m_header;
+    std::string m_next_header;
+    std::string_view m_sequence;
+    std::string m_multiline_sequence;
+
+    bool next_multiline() {
+        bool has_record = m_open_record;
+        m_header.clear();
+        if (m_open_record) m_header.swap(m_next_header);
+        m_open_record = false;
+        m_multiline_sequence.clear();
+        std::string_view line;
+        while (m_lines.next(line)) {
+            if (!line.empty() and line.front() == '>') {
+                if (has_record) {
+                    m_next_header.assign(line);
+                    m_open_record = true;
+                    break;
+                }
+                m_header.assign(line);
+            } else {
+                m_multiline_sequence.append(line);
+            }
+            has_record = true;
+        }
+        m_sequence = m_multiline_sequence;
+        return has_record;
+    }
+};
+
+}  // namespace sshash
@@ -0,0 +1,284 @@
+#include "threaded_zip_stream.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sshash {
+
+/*
+    Return the size of the BGZF member starting at p, or 0 if p does not point to
+    a BGZF member header: a gzip header with an extra subfield 'BC' of length 2
+    holding the member size minus 1.
+*/
+static uint64_t bgzf_member_size(unsigned char const* p, uint64_t avail) {
+    constexpr uint64_t header_size = 12;
+    if (avail < header_size or p[0] != 0x1f or p[1] != 0x8b or p[2] != 8 or (p[3] & 4) == 0) {
+        return 0;
+    }
+    uint64_t xlen = p[10] | (p[11] << 8);
+    if (avail < header_size + xlen) return 0;
+    unsigned char const* extra = p + header_size;
+    for (uint64_t i = 0; i + 4 <= xlen;) {
+        uint64_t slen = extra[i + 2] | (extra[i + 3] << 8);
+        if (extra[i] == 'B' and extra[i + 1] == 'C' and slen == 2 and i + 6 <= xlen) {
+            uint64_t size = (extra[i + 4] | (extra[i + 5] << 8)) + 1;
+            return size <= avail ? size : 0;
+        }
+        i += 4 + slen;
+    }
+    return 0;
+}
+
+static uint32_t read_uint32_le(unsigned char const* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) |
+           (uint32_t(p[3]) << 24);
+}
+
+threaded_unzip_streambuf::threaded_unzip_streambuf(std::string const& filename,
+                                                   uint64_t num_threads)
+    : m_file(nullptr)
+    , m_file_size(0)
+    , m_bgzf(false)
+    , m_next(0)
+    , m_num_blocks(uint64_t(-1))
+    , m_next_job(0)
+    , m_stop(false)
+    , m_holding(false) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1) throw std::runtime_error("cannot open file '" + filename + "'");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot stat file '" + filename + "'");
+    }
+    m_file_size = st.st_size;
+    if (m_file_size != 0) {
+        void* ptr = mmap(nullptr, m_file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("cannot mmap file '" + filename + "'");
+        }
+        madvise(ptr, m_file_size, MADV_SEQUENTIAL);
+        m_file = static_cast<unsigned char const*>(ptr);
+    }
+    ::close(fd);
+
+    if (num_threads == 0) num_threads = 1;
+
+    /* group the BGZF members into jobs of about block_size compressed bytes */
+    m_bgzf = m_file_size != 0 and bgzf_member_size(m_file, m_file_size) != 0;
+    if (m_bgzf) {
+        m_job_offsets.push_back(0);
+        for (uint64_t pos = 0; pos != m_file_size;) {
+            uint64_t size = bgzf_member_size(m_file + pos, m_file_size - pos);
+            if (size == 0) {  // not BGZF after all
+                m_bgzf = false;
+                m_job_offsets.clear();
+                break;
+            }
+            pos += size;
+            if (pos - m_job_offsets.back() >= block_size or pos == m_file_size) {
+                m_job_offsets.push_back(pos);
+            }
+        }
+    }
+
+    if (m_bgzf) {
+        m_num_blocks = m_job_offsets.size() - 1;
+        m_ring.resize(2 * num_threads);
+    } else {
+        num_threads = 1;
+        m_ring.resize(4);
+    }
+    for (uint64_t i = 0; i != m_ring.size(); ++i) {
+        m_ring[i].sequence_number = i;
+        m_ring[i].ready = false;
+    }
+
+    if (m_file_size == 0) {
+        m_num_blocks = 0;
+        return;
+    }
+    for (uint64_t t = 0; t != num_threads; ++t) {
+        m_threads.emplace_back([this]() {
+            if (m_bgzf) {
+                inflate_bgzf();
+            } else {
+                inflate_serial();
+            }
+        });
+    }
+}
+
+threaded_unzip_streambuf::~threaded_unzip_streambuf() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_cv.notify_all();
+    }
+    for (auto& t : m_threads) t.join();
+    if (m_file != nullptr) munmap(const_cast<unsigned char*>(m_file), m_file_size);
+}
+
+threaded_unzip_streambuf::int_type threaded_unzip_streambuf::underflow() {
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        if (m_holding) {  // give the consumed block back to the producers
+            block& prev = m_ring[(m_next - 1) % m_ring.size()];
+            prev.ready = false;
+            prev.sequence_number += m_ring.size();
+            m_holding = false;
+            m_cv.notify_all();
+        }
+        block& b = m_ring[m_next % m_ring.size()];
+        m_cv.wait(lock, [&] {
+            return !m_error.empty() or m_next == m_num_blocks or
+                   (b.ready and b.sequence_number == m_next);
+        });
+        if (!m_error.empty()) throw std::runtime_error(m_error);
+        if (m_next == m_num_blocks) {
+            setg(nullptr, nullptr, nullptr);
+            return traits_type::eof();
+        }
+        ++m_next;
+        m_holding = true;
+        if (b.data.empty()) continue;
+        setg(b.data.data(), b.data.data(), b.data.data() + b.data.size());
+        return traits_type::to_int_type(*gptr());
+    }
+}
+
+/* Wait until the slot of the given block is free; return nullptr if stopping. */
+threaded_unzip_streambuf::block* threaded_unzip_streambuf::acquire(uint64_t sequence_number) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    block& b = m_ring[sequence_number % m_ring.size()];
+    m_cv.wait(lock, [&] {
+        return m_stop or !m_error.empty() or
+               (!b.ready and b.sequence_number == sequence_number);
+    });
+    if (m_stop or !m_error.empty()) return nullptr;
+    return &b;
+}
+
+void threaded_unzip_streambuf::publish(block* b) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    b->ready = true;
+    m_cv.notify_all();
+}
+
+void threaded_unzip_streambuf::fail(std::string const& error) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_error.empty()) m_error = error;
+    m_cv.notify_all();
+}
+
+void threaded_unzip_streambuf::inflate_serial() {
+    z_stream zs = {};
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) {  // +32: detect the gzip or zlib header
+        fail("inflateInit2 failed");
+        return;
+    }
+    constexpr uint64_t max_avail_in = 1ULL << 30;  // avail_in is 32-bit
+    zs.next_in = const_cast<unsigned char*>(m_file);
+    uint64_t sequence_number = 0;
+    block* b = nullptr;
+
+    while (true) {
+        if (b == nullptr) {
+            b = acquire(sequence_number);
+            if (b == nullptr) break;
+            b->data.resize(block_size);
+            zs.next_out = reinterpret_cast<unsigned char*>(b->data.data());
+            zs.avail_out = block_size;
+        }
+        uint64_t pos = zs.next_in - m_file;
+        if (zs.avail_in == 0) zs.avail_in = std::min(m_file_size - pos, max_avail_in);
+
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        bool done = false;
+        if (ret == Z_STREAM_END) {
+            /* continue if another gzip member follows, otherwise ignore the trailing bytes */
+            pos = zs.next_in - m_file;
+            if (m_file_size - pos >= 2 and zs.next_in[0] == 0x1f and zs.next_in[1] == 0x8b) {
+                inflateReset(&zs);
+            } else {
+                done = true;
+            }
+        } else if (ret != Z_OK) {
+            bool truncated = ret == Z_BUF_ERROR and zs.next_in == m_file + m_file_size;
+            fail(truncated ? "unexpected end of gzip file"
+                           : std::string("invalid gzip data: ") + (zs.msg ? zs.msg : ""));
+            break;
+        }
+
+        if (zs.avail_out == 0 or done) {
+            b->data.resize(block_size - zs.avail_out);
+            publish(b);
+            b = nullptr;
+            ++sequence_number;
+        }
+        if (done) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_num_blocks = sequence_number;
+            m_cv.notify_all();
+            break;
+        }
+    }
+    inflateEnd(&zs);
+}
+
+void threaded_unzip_streambuf::inflate_bgzf() {
+    z_stream zs = {};
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {  // +16: gzip header
+        fail("inflateInit2 failed");
+        return;
+    }
+    uint64_t num_jobs = m_job_offsets.size() - 1;
+    for (uint64_t job = m_next_job++; job < num_jobs; job = m_next_job++) {
+        block* b = acquire(job);
+        if (b == nullptr) break;
+        uint64_t begin = m_job_offsets[job];
+        uint64_t end = m_job_offsets[job + 1];
+
+        /* the inflated size of a member is in its last 4 bytes */
+        uint64_t size = 0;
+        for (uint64_t pos = begin; pos != end; pos += bgzf_member_size(m_file + pos, end - pos)) {
+            uint64_t member_end = pos + bgzf_member_size(m_file + pos, end - pos);
+            size += read_uint32_le(m_file + member_end - 4);
+        }
+        b->data.resize(size);
+
+        uint64_t out = 0;
+        bool ok = true;
+        for (uint64_t pos = begin; pos != end and ok;) {
+            uint64_t member_size = bgzf_member_size(m_file + pos, end - pos);
+            uint32_t member_out = read_uint32_le(m_file + pos + member_size - 4);
+            inflateReset(&zs);
+            zs.next_in = const_cast<unsigned char*>(m_file + pos);
+            zs.avail_in = member_size;
+            zs.next_out = reinterpret_cast<unsigned char*>(b->data.data() + out);
+            zs.avail_out = size - out;
+            int ret = inflate(&zs, Z_FINISH);
+            ok = ret == Z_STREAM_END and zs.total_out == member_out;
+            out += member_out;
+            pos += member_size;
+        }
+        if (!ok) {
+            fail("invalid BGZF member");
+            break;
+        }
+        publish(b);
+    }
+    inflateEnd(&zs);
+}
+
+}  // namespace sshash
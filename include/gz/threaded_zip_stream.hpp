@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sshash {
+
+/*
+    A streambuf over a gzip file that is inflated ahead of the reader by background
+    threads, into a ring of blocks consumed in order.
+    - BGZF files (e.g., from bgzip), whose members record their compressed size in the
+      header, are split into groups of consecutive members that num_threads threads
+      inflate in parallel.
+    - Any other gzip file (including multi-member files) is inflated by a single
+      background thread, member after member, since the member boundaries are only
+      known after inflating.
+*/
+class threaded_unzip_streambuf : public std::streambuf {
+public:
+    threaded_unzip_streambuf(std::string const& filename, uint64_t num_threads);
+    ~threaded_unzip_streambuf();
+
+    bool is_bgzf() const { return m_bgzf; }
+
+protected:
+    int_type underflow() override;
+
+private:
+    static constexpr uint64_t block_size = 1ULL << 20;  // compressed (BGZF) or inflated bytes
+
+    struct block {
+        std::vector<char> data;
+        uint64_t sequence_number;  // of the block that can use this slot
+        bool ready;
+    };
+
+    unsigned char const* m_file;
+    uint64_t m_file_size;
+    bool m_bgzf;
+
+    std::vector<block> m_ring;
+    uint64_t m_next;                      // sequence number of the next block to consume
+    uint64_t m_num_blocks;                // known once the producers are done
+    std::atomic<uint64_t> m_next_job;     // BGZF: next group of members to inflate
+    std::vector<uint64_t> m_job_offsets;  // BGZF: the groups of members are delimited here
+    std::string m_error;
+    bool m_stop;
+    bool m_holding;  // the reader still points into the block before m_next
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::thread> m_threads;
+
+    block* acquire(uint64_t sequence_number);
+    void publish(block* b);
+    void fail(std::string const& error);
+    void inflate_serial();
+    void inflate_bgzf();
+};
+
+/* An std::istream reading the inflated content of a gzip file (see above). */
+class threaded_zip_istream final : public threaded_unzip_streambuf, public std::istream {
+public:
+    threaded_zip_istream(std::string const& filename, uint64_t num_threads = 1)
+        : threaded_unzip_streambuf(filename, num_threads), std::istream(this) {
+        exceptions(std::ios::badbit);  // report a corrupted input, instead of a short read
+    }
+};
+
+}  // namespace sshash
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <fstream>
+#include <string>
+#include <type_traits>
+
+#include <sys/mman.h>
+
+#include "constants.hpp"
+
+#if defined(__linux__) and !defined(MADV_COLLAPSE)
+#define MADV_COLLAPSE 25  // Linux >= 6.1, not yet exposed by older C libraries
+#endif
+
+namespace sshash {
+
+constexpr uint64_t huge_page_size = 1ULL << 21;
+
+/*
+    The large arrays of a dictionary are std::vectors of the pthash containers, allocated
+    by the global operator new, which the tools replace with huge_pages_allocate
+    (see src/common.hpp). While huge_page_allocations() is set, an allocation of at least
+    half a huge page is 2 MB-aligned, padded to a multiple of 2 MB and advised to use huge
+    pages, so that the whole array (not only its 2 MB-aligned interior) is eligible.
+    Otherwise, an allocation of at least a page is cache-line-aligned, so that the
+    positions of an array that are aligned relative to its beginning (e.g., the records
+    of the locality layout of the buckets) are also aligned in memory.
+*/
+inline std::atomic<bool>& huge_page_allocations() {
+    static std::atomic<bool> enabled(false);
+    return enabled;
+}
+
+/* Set huge_page_allocations() for the lifetime of the object. */
+struct huge_page_allocations_scope {
+    huge_page_allocations_scope(bool enable) : m_enabled(enable) {
+        if (m_enabled) huge_page_allocations() = true;
+    }
+    ~huge_page_allocations_scope() {
+        if (m_enabled) huge_page_allocations() = false;
+    }
+
+private:
+    bool m_enabled;
+};
+
+/* Return memory to be released with std::free, or nullptr. */
+inline void* huge_pages_allocate(std::size_t num_bytes) {
+    if (num_bytes >= huge_page_size / 2 and
+        huge_page_allocations().load(std::memory_order_relaxed)) {
+        std::size_t size = (num_bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+        void* ptr = std::aligned_alloc(huge_page_size, size);
+        if (ptr != nullptr) {
+            madvise(ptr, size, MADV_HUGEPAGE);
+            return ptr;
+        }
+    }
+    if (num_bytes >= 4096) {
+        constexpr std::size_t line = constants::cache_line_size;
+        void* ptr = std::aligned_alloc(line, (num_bytes + line - 1) & ~(line - 1));
+        if (ptr != nullptr) return ptr;
+    }
+    return std::malloc(num_bytes == 0 ? 1 : num_bytes);
+}
+
+/*
+    A visitor that asks the kernel to back the large arrays of a loaded data structure
+    with 2 MB transparent huge pages, to reduce the TLB misses of random accesses.
+    Only the 2 MB-aligned part of each array can be backed: all of it if the array was
+    allocated with huge_page_allocations() set. The pages already in memory
+    are collapsed synchronously (MADV_COLLAPSE, Linux >= 6.1); otherwise they are left
+    to khugepaged.
+*/
+struct huge_pages_advisor {
+    huge_pages_advisor() : m_advised_bytes(0), m_collapsed_bytes(0) {}
+
+    template <typename T>
+    void visit(T& val) {
+        if constexpr (!is_pod<T>()) val.visit(*this);
+    }
+
+    template <typename T, typename Allocator>
+    void visit(std::vector<T, Allocator>& vec) {
+        if constexpr (is_pod<T>()) {
+            advise(vec.data(), vec.size() * sizeof(T));
+        } else {
+            for (auto& v : vec) visit(v);
+        }
+    }
+
+    /* Number of bytes advised to use huge pages, and collapsed into huge pages. */
+    uint64_t advised_bytes() const { return m_advised_bytes; }
+    uint64_t collapsed_bytes() const { return m_collapsed_bytes; }
+
+private:
+    uint64_t m_advised_bytes;
+    uint64_t m_collapsed_bytes;
+
+    template <typename T>
+    static constexpr bool is_pod() {
+        return std::is_trivial<T>::value and std::is_standard_layout<T>::value;
+    }
+
+    void advise(void const* data, uint64_t num_bytes) {
+        uint64_t begin = reinterpret_cast<uint64_t>(data);
+        uint64_t end = begin + num_bytes;
+        begin = (begin + huge_page_size - 1) & ~(huge_page_size - 1);
+        end &= ~(huge_page_size - 1);
+        if (begin >= end) return;
+        void* ptr = reinterpret_cast<void*>(begin);
+        if (madvise(ptr, end - begin, MADV_HUGEPAGE) != 0) return;
+        m_advised_bytes += end - begin;
+#ifdef MADV_COLLAPSE
+        if (madvise(ptr, end - begin, MADV_COLLAPSE) == 0) m_collapsed_bytes += end - begin;
+#endif
+    }
+};
+
+template <typename T>
+huge_pages_advisor use_huge_pages(T& data_structure) {
+    huge_pages_advisor advisor;
+    advisor.visit(data_structure);
+    return advisor;
+}
+
+/* Return the bytes of anonymous memory of this process backed by huge pages. */
+inline uint64_t anon_huge_pages_bytes() {
+    std::ifstream in("/proc/self/smaps_rollup");
+    std::string key;
+    uint64_t kb = 0;
+    while (in >> key) {
+        if (key == "AnonHugePages:") {
+            in >> kb;
+            break;
+        }
+    }
+    return kb * 1024;
+}
+
+}  // namespace sshash
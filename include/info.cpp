@@ -31,11 +31,20 @@ void dictionary::print_space_breakdown() const {
               << " [bits/kmer]\n";
     std::cout << "  pieces: " << static_cast<double>(m_buckets.pieces.num_bits()) / size()
               << " [bits/kmer]\n";
-    std::cout << "  num_super_kmers_before_bucket: "
-              << static_cast<double>(m_buckets.num_super_kmers_before_bucket.num_bits()) / size()
+    std::cout << "  num_kmers_before_contig: "
+              << static_cast<double>(m_buckets.num_kmers_before_contig.num_bits()) / size()
               << " [bits/kmer]\n";
-    std::cout << "  offsets: " << static_cast<double>(8 * m_buckets.offsets.bytes()) / size()
+    std::cout << "  num_super_kmers_before_bucket"
+              << (m_buckets.singleton_split() ? " (non-singleton buckets)" : "") << ": "
+              << static_cast<double>(m_buckets.num_super_kmers_before_bucket.num_bits()) / size()
               << " [bits/kmer]\n";
+    if (m_buckets.singleton_split()) {
+        std::cout << "  singleton_buckets: "
+                  << static_cast<double>(m_buckets.singleton_buckets.num_bits()) / size()
+                  << " [bits/kmer]\n";
+    }
+    std::cout << "  offsets" << (m_buckets.locality_layout() ? " (locality layout)" : "") << ": "
+              << static_cast<double>(8 * m_buckets.offsets.bytes()) / size() << " [bits/kmer]\n";
     std::cout << "  strings: " << static_cast<double>(8 * m_buckets.strings.bytes()) / size()
               << " [bits/kmer]\n";
     std::cout << "  skew_index: " << static_cast<double>(m_skew_index.num_bits()) / size()
@@ -43,6 +52,8 @@ void dictionary::print_space_breakdown() const {
     std::cout << "  weights: " << static_cast<double>(m_weights.num_bits()) / size()
               << " [bits/kmer]\n";
     m_weights.print_space_breakdown(size());
+    std::cout << "  filter: " << static_cast<double>(m_filter.num_bits()) / size()
+              << " [bits/kmer]\n";
     std::cout << "  --------------\n";
     std::cout << "  total: " << static_cast<double>(num_bits()) / size() << " [bits/kmer]"
               << std::endl;
@@ -57,7 +68,7 @@ void dictionary::print_info() const {
     std::cout << "canonicalized = " << (canonicalized() ? "true" : "false") << '\n';
     std::cout << "weighted = " << (weighted() ? "true" : "false") << '\n';
 
-    std::cout << "num_super_kmers = " << m_buckets.offsets.size() << '\n';
+    std::cout << "num_super_kmers = " << m_buckets.num_super_kmers() << '\n';
     std::cout << "num_pieces = " << m_buckets.pieces.size() << " (+"
               << (2.0 * m_buckets.pieces.size() * (k() - 1)) / size() << " [bits/kmer])" << '\n';
     std::cout << "bits_per_offset = ceil(log2(" << m_buckets.strings.size() / 2
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+
+#include "hash_util.hpp"
+
+namespace sshash {
+
+/*
+    A blocked Bloom filter over the k-mers of the dictionary, used to answer most
+    negative lookups before touching the minimizers MPHF and the buckets.
+    Each k-mer sets (and is checked against) num_hashes bits of a single block of
+    512 bits (one cache line), so a query costs at most one cache miss.
+    With canonical parsing, the canonical k-mer (the smaller between a k-mer and its
+    reverse complement) is stored.
+*/
+struct kmer_filter {
+    static constexpr uint64_t block_size = 512;  // in bits
+    static constexpr uint64_t words_per_block = block_size / 64;
+    static constexpr uint64_t max_num_hashes = 7;  // 9 bits per hash from a 64-bit value
+
+    struct builder {
+        builder() : m_num_blocks(0), m_num_hashes(0) {}
+
+        builder(uint64_t num_kmers, uint64_t bits_per_kmer) {
+            assert(bits_per_kmer > 0);
+            m_num_blocks = (num_kmers * bits_per_kmer + block_size - 1) / block_size;
+            if (m_num_blocks == 0) m_num_blocks = 1;
+            /* k = ln(2) * bits_per_kmer minimizes the false positive rate */
+            m_num_hashes = std::max<uint64_t>(
+                1, std::min<uint64_t>(std::round(std::log(2.0) * bits_per_kmer), max_num_hashes));
+            m_bits.resize(m_num_blocks * words_per_block, 0);
+        }
+
+        /* Thread-safe: different threads can add k-mers concurrently. */
+        void add(kmer_t uint_kmer) {
+            auto [block, bits] = kmer_filter::hash(uint_kmer, m_num_blocks);
+            uint64_t* ptr = m_bits.data() + block * words_per_block;
+            for (uint64_t i = 0; i != m_num_hashes; ++i, bits >>= 9) {
+                uint64_t pos = bits & (block_size - 1);
+                __atomic_fetch_or(ptr + (pos >> 6), uint64_t(1) << (pos & 63), __ATOMIC_RELAXED);
+            }
+        }
+
+        void build(kmer_filter& filter) {
+            filter.m_num_blocks = m_num_blocks;
+            filter.m_num_hashes = m_num_hashes;
+            filter.m_bits.swap(m_bits);
+            builder().swap(*this);
+        }
+
+        void swap(builder& other) {
+            std::swap(m_num_blocks, other.m_num_blocks);
+            std::swap(m_num_hashes, other.m_num_hashes);
+            m_bits.swap(other.m_bits);
+        }
+
+    private:
+        uint64_t m_num_blocks;
+        uint64_t m_num_hashes;
+        std::vector<uint64_t> m_bits;
+    };
+
+    kmer_filter() : m_num_blocks(0), m_num_hashes(0) {}
+
+    bool empty() const { return m_num_blocks == 0; }
+    uint64_t num_hashes() const { return m_num_hashes; }
+
+    /* Return false only if uint_kmer is not in the dictionary. */
+    bool contains(kmer_t uint_kmer) const {
+        if (empty()) return true;
+        auto [block, bits] = hash(uint_kmer, m_num_blocks);
+        uint64_t const* ptr = m_bits.data() + block * words_per_block;
+        for (uint64_t i = 0; i != m_num_hashes; ++i, bits >>= 9) {
+            uint64_t pos = bits & (block_size - 1);
+            if ((ptr[pos >> 6] & (uint64_t(1) << (pos & 63))) == 0) return false;
+        }
+        return true;
+    }
+
+    void prefetch(kmer_t uint_kmer) const {
+        if (empty()) return;
+        uint64_t block = hash(uint_kmer, m_num_blocks).first;
+        __builtin_prefetch(m_bits.data() + block * words_per_block);
+    }
+
+    uint64_t num_bits() const {
+        return 8 * (sizeof(m_num_blocks) + sizeof(m_num_hashes) + sizeof(size_t) +
+                    m_bits.size() * sizeof(uint64_t));
+    }
+
+    template <typename Visitor>
+    void visit(Visitor& visitor) {
+        visitor.visit(m_num_blocks);
+        visitor.visit(m_num_hashes);
+        visitor.visit(m_bits);
+    }
+
+private:
+    uint64_t m_num_blocks;
+    uint64_t m_num_hashes;
+    std::vector<uint64_t> m_bits;
+
+    /* Return the block of uint_kmer and the bits selecting its positions in the block. */
+    static std::pair<uint64_t, uint64_t> hash(kmer_t uint_kmer, uint64_t num_blocks) {
+        auto h = kmers_base_hasher_type::hash(uint_kmer, constants::seed);
+        uint64_t block = (static_cast<__uint128_t>(h.first()) * num_blocks) >> 64;
+        return {block, h.second()};
+    }
+};
+
+}  // namespace sshash
@@ -67,27 +67,36 @@ struct minimizer_enumerator {
             if constexpr (reverse) {
                 for (uint64_t i = 0; i != m_k - m_m + 1; ++i) {
                     uint64_t mmer = static_cast<uint64_t>((kmer >> (2 * (m_k - m_m - i))) & m_mask);
-                    eat(mmer);
+                    eat<reverse>(mmer);
                 }
             } else {
                 for (uint64_t i = 0; i != m_k - m_m + 1; ++i) {
                     uint64_t mmer = static_cast<uint64_t>(kmer & m_mask);
                     kmer >>= 2;
-                    eat(mmer);
+                    eat<reverse>(mmer);
                 }
             }
         } else {
             if constexpr (reverse) {
                 uint64_t mmer = static_cast<uint64_t>(kmer & m_mask);
-                eat(mmer);
+                eat<reverse>(mmer);
             } else {
                 uint64_t mmer = static_cast<uint64_t>(kmer >> (2 * (m_k - m_m)));
-                eat(mmer);
+                eat<reverse>(mmer);
             }
         }
         return m_q.front().value;
     }
 
+    /* Return the position of the current minimizer in the last k-mer,
+       as computed by util::compute_minimizer_pos. */
+    template <bool reverse = false>
+    uint64_t position() const {
+        uint64_t pos = m_q.front().position;
+        if constexpr (reverse) return m_position - 1 - pos;
+        return pos + m_k - m_m + 1 - m_position;
+    }
+
 private:
     uint64_t m_k;
     uint64_t m_m;
@@ -106,6 +115,12 @@ private:
              but std::deque is terribly space-inefficient. */
     fixed_size_deque<mmer_t> m_q;
 
+    /*
+        In reverse mode the m-mers of a k-mer are eaten from the last one to the first:
+        on ties, keep the most recent m-mer, so that the leftmost one is selected
+        (as util::compute_minimizer does).
+    */
+    template <bool reverse>
     void eat(uint64_t mmer) {
         uint64_t hash = Hasher::hash(mmer, m_seed);
 
@@ -115,7 +130,11 @@ private:
             m_q.pop_front();
         }
         /* Removes from back elements which are no longer useful */
-        while (!m_q.empty() and hash < m_q.back().hash) m_q.pop_back();
+        if constexpr (reverse) {
+            while (!m_q.empty() and hash <= m_q.back().hash) m_q.pop_back();
+        } else {
+            while (!m_q.empty() and hash < m_q.back().hash) m_q.pop_back();
+        }
 
         m_q.push_back({hash, m_position, mmer});
         m_position += 1;
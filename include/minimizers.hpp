@@ -5,6 +5,10 @@
 namespace sshash {
 
 struct minimizers {
+    /* A conservative estimate of the peak memory used by PTHash
+       to build the MPHF in internal memory. */
+    static constexpr uint64_t mphf_bytes_per_key_in_internal_memory = 64;
+
     template <typename ForwardIterator>
     void build(ForwardIterator begin, uint64_t size, build_configuration const& build_config) {
         pthash::build_configuration mphf_config;
@@ -23,9 +27,13 @@ struct minimizers {
                       << " threads..." << std::endl;
         }
 
-        mphf_config.ram = 2 * essentials::GB;
+        mphf_config.ram = build_config.ram;
         mphf_config.tmp_dir = build_config.tmp_dirname;
-        m_mphf.build_in_external_memory(begin, size, mphf_config);
+        if (size * mphf_bytes_per_key_in_internal_memory <= build_config.ram) {
+            m_mphf.build_in_internal_memory(begin, size, mphf_config);
+        } else {
+            m_mphf.build_in_external_memory(begin, size, mphf_config);
+        }
     }
 
     uint64_t lookup(uint64_t uint64_minimizer) const {
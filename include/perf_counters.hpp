@@ -0,0 +1,196 @@
+#pragma once
+
+/*
+    Optional per-stage hardware counters for the lookup paths, compiled in with the
+    CMake option SSHASH_USE_PERF_COUNTERS (which defines SSHASH_PERF_COUNTERS).
+    Otherwise SSHASH_PERF_SCOPE expands to nothing.
+*/
+
+#ifdef SSHASH_PERF_COUNTERS
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace sshash {
+namespace perf {
+
+enum stage : uint32_t {
+    minimizer = 0,    // minimizer hashing
+    mphf,             // MPHF lookup of the minimizer
+    locate_bucket,    // bucket boundaries
+    skew_index,       // skew-index probe (large buckets only)
+    super_kmer_scan,  // scan of the super-k-mers
+    num_stages
+};
+
+enum counter : uint32_t { cycles = 0, cache_misses, branch_misses, num_counters };
+
+/*
+    A counting event of the calling thread. The counter is read in user space with
+    rdpmc if the kernel allows it (about 30 cycles), otherwise with read().
+*/
+struct event {
+    event() : m_fd(-1), m_page(nullptr) {}
+
+    bool open(uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = syscall(SYS_perf_event_open, &attr, 0 /* this thread */, -1 /* any cpu */,
+                       -1 /* no group */, 0);
+        if (m_fd == -1) return false;
+        void* page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, m_fd, 0);
+        if (page != MAP_FAILED) m_page = static_cast<perf_event_mmap_page*>(page);
+        return true;
+    }
+
+    ~event() {
+        if (m_page != nullptr) munmap(m_page, sysconf(_SC_PAGESIZE));
+        if (m_fd != -1) close(m_fd);
+    }
+
+    uint64_t read() const {
+#if defined(__x86_64__)
+        if (m_page != nullptr and m_page->cap_user_rdpmc) {
+            uint32_t seq;
+            uint64_t count;
+            do {  // seqlock protocol of perf_event_mmap_page
+                seq = m_page->lock;
+                __atomic_signal_fence(__ATOMIC_SEQ_CST);
+                uint32_t index = m_page->index;
+                count = m_page->offset;
+                if (index == 0) break;  // not scheduled on a counter: use read()
+                uint64_t shift = 64 - m_page->pmc_width;
+                count += static_cast<int64_t>(__rdpmc(index - 1) << shift) >> shift;
+                __atomic_signal_fence(__ATOMIC_SEQ_CST);
+                if (m_page->lock == seq) return count;
+            } while (true);
+        }
+#endif
+        uint64_t count = 0;
+        if (::read(m_fd, &count, sizeof(count)) != sizeof(count)) return 0;
+        return count;
+    }
+
+private:
+    int m_fd;
+    perf_event_mmap_page* m_page;
+};
+
+/*
+    The counters of the calling thread and the per-stage totals. If the hardware events
+    cannot be opened (e.g., no PMU in a virtual machine), cycles are counted with the
+    time-stamp counter and the misses are not available.
+*/
+struct counters {
+    counters() {
+        m_available = m_events[cycles].open(PERF_COUNT_HW_CPU_CYCLES) and
+                      m_events[cache_misses].open(PERF_COUNT_HW_CACHE_MISSES) and
+                      m_events[branch_misses].open(PERF_COUNT_HW_BRANCH_MISSES);
+        reset();
+    }
+
+    bool available() const { return m_available; }
+
+    void read(uint64_t* values) const {
+        if (!m_available) {
+#if defined(__x86_64__)
+            values[cycles] = __rdtsc();
+#else
+            values[cycles] = 0;
+#endif
+            values[cache_misses] = values[branch_misses] = 0;
+            return;
+        }
+        for (uint32_t i = 0; i != num_counters; ++i) values[i] = m_events[i].read();
+    }
+
+    void add(stage s, uint64_t const* begin, uint64_t const* end) {
+        calls[s] += 1;
+        for (uint32_t i = 0; i != num_counters; ++i) totals[s][i] += end[i] - begin[i];
+    }
+
+    void reset() {
+        std::memset(calls, 0, sizeof(calls));
+        std::memset(totals, 0, sizeof(totals));
+    }
+
+    void print(std::ostream& os) const {
+        static constexpr char const* stage_names[num_stages] = {
+            "minimizer", "mphf", "locate_bucket", "skew_index", "super_kmer_scan"};
+        auto precision = os.precision();
+        os << "per-stage counters (averages per call"
+           << (m_available ? ")" : "; no hardware counters: cycles from the time-stamp counter)")
+           << ":\n";
+        os << "  " << std::left << std::setw(18) << "stage" << std::right << std::setw(12)
+           << "calls" << std::setw(12) << "cycles" << std::setw(14) << "cache_misses"
+           << std::setw(15) << "branch_misses" << '\n';
+        for (uint32_t s = 0; s != num_stages; ++s) {
+            double n = calls[s] ? calls[s] : 1;
+            os << "  " << std::left << std::setw(18) << stage_names[s] << std::right
+               << std::setw(12) << calls[s] << std::fixed << std::setprecision(2)
+               << std::setw(12) << totals[s][cycles] / n;
+            if (m_available) {
+                os << std::setw(14) << totals[s][cache_misses] / n << std::setw(15)
+                   << totals[s][branch_misses] / n;
+            } else {
+                os << std::setw(14) << "n/a" << std::setw(15) << "n/a";
+            }
+            os << '\n';
+        }
+        os << std::defaultfloat << std::setprecision(precision) << std::flush;
+    }
+
+    uint64_t calls[num_stages];
+    uint64_t totals[num_stages][num_counters];
+
+private:
+    bool m_available;
+    event m_events[num_counters];
+};
+
+inline counters& thread_counters() {
+    static thread_local counters c;
+    return c;
+}
+
+/* Charge the events counted during the lifetime of the scope to a stage. */
+struct scope {
+    scope(stage s) : m_stage(s) { thread_counters().read(m_begin); }
+    ~scope() {
+        uint64_t end[num_counters];
+        auto& c = thread_counters();
+        c.read(end);
+        c.add(m_stage, m_begin, end);
+    }
+
+private:
+    stage m_stage;
+    uint64_t m_begin[num_counters];
+};
+
+}  // namespace perf
+}  // namespace sshash
+
+#define SSHASH_PERF_SCOPE(stage) sshash::perf::scope perf_scope_##stage(sshash::perf::stage)
+
+#else
+
+#define SSHASH_PERF_SCOPE(stage)
+
+#endif
@@ -3,12 +3,100 @@
 #include "../dictionary.hpp"
 #include "../util.hpp"
 
-#include "../gz/zip_stream.hpp"
+#include "../gz/threaded_zip_stream.hpp"
+#include "../bounded_queue.hpp"
+#include "../fastx_reader.hpp"
 #include "streaming_query_canonical_parsing.hpp"
 #include "streaming_query_regular_parsing.hpp"
 
 namespace sshash {
 
+/*
+    The per-read summary of a streaming query, written by the query tool with -o.
+    TSV format, one line per read:
+        name num_kmers num_forward_hits num_backward_hits first_hit last_hit contig_ids
+    where first_hit and last_hit are the positions of the first and last positive
+    k-mers in the read ('*' if there is none) and contig_ids is the comma-separated,
+    sorted list of the distinct contigs hit ('*' if none).
+    Binary format, one record per read (little-endian, no name):
+        uint32 num_kmers, num_forward_hits, num_backward_hits, first_hit, last_hit,
+        num_contigs; uint64 contig_ids[num_contigs]
+    where a missing first_hit/last_hit is encoded as 2^32-1.
+*/
+struct read_result {
+    read_result() { clear(); }
+
+    void clear() {
+        num_kmers = 0;
+        num_forward_hits = 0;
+        num_backward_hits = 0;
+        first_hit = constants::invalid_uint32;
+        last_hit = constants::invalid_uint32;
+        contig_ids.clear();
+    }
+
+    void add(lookup_result const& answer) {
+        if (answer.kmer_id != constants::invalid_uint64) {
+            if (answer.kmer_orientation == constants::forward_orientation) {
+                num_forward_hits += 1;
+            } else {
+                num_backward_hits += 1;
+            }
+            if (first_hit == constants::invalid_uint32) first_hit = num_kmers;
+            last_hit = num_kmers;
+            /* consecutive hits are mostly on the same contig */
+            if (contig_ids.empty() or contig_ids.back() != answer.contig_id) {
+                contig_ids.push_back(answer.contig_id);
+            }
+        }
+        num_kmers += 1;
+    }
+
+    void append_to(std::string& out, std::string const& name, bool binary) {
+        std::sort(contig_ids.begin(), contig_ids.end());
+        contig_ids.erase(std::unique(contig_ids.begin(), contig_ids.end()), contig_ids.end());
+        if (binary) {
+            uint32_t header[6] = {num_kmers,  num_forward_hits, num_backward_hits,
+                                  first_hit,  last_hit,         uint32_t(contig_ids.size())};
+            out.append(reinterpret_cast<char const*>(header), sizeof(header));
+            out.append(reinterpret_cast<char const*>(contig_ids.data()),
+                       contig_ids.size() * sizeof(uint64_t));
+            return;
+        }
+        auto append_position = [&](uint32_t pos) {
+            out += '\t';
+            if (pos == constants::invalid_uint32) {
+                out += '*';
+            } else {
+                out += std::to_string(pos);
+            }
+        };
+        out += name;
+        out += '\t';
+        out += std::to_string(num_kmers);
+        out += '\t';
+        out += std::to_string(num_forward_hits);
+        out += '\t';
+        out += std::to_string(num_backward_hits);
+        append_position(first_hit);
+        append_position(last_hit);
+        out += '\t';
+        if (contig_ids.empty()) out += '*';
+        for (uint64_t i = 0; i != contig_ids.size(); ++i) {
+            if (i != 0) out += ',';
+            out += std::to_string(contig_ids[i]);
+        }
+        out += '\n';
+    }
+
+    uint32_t num_kmers;
+    uint32_t num_forward_hits;
+    uint32_t num_backward_hits;
+    uint32_t first_hit;
+    uint32_t last_hit;
+    std::vector<uint64_t> contig_ids;
+};
+
 template <typename Query>
 streaming_query_report streaming_query_from_fasta_file_multiline(dictionary const* dict,
                                                                  std::istream& is) {
@@ -20,7 +108,7 @@ streaming_query_report streaming_query_from_fasta_file_multiline(dictionary cons
     query.start();
     while (!it.eof()) {
         bool empty_line_was_read = it.fill_buffer(buffer);
-        for (uint64_t i = 0; i != buffer.size() - k + 1; ++i) {
+        for (uint64_t i = 0; i + k <= buffer.size(); ++i) {
             char const* kmer = buffer.data() + i;
             auto answer = query.lookup_advanced(kmer);
             report.num_kmers += 1;
@@ -42,119 +130,350 @@ streaming_query_report streaming_query_from_fasta_file_multiline(dictionary cons
     return report;
 }
 
+/* Set name to the first word of header, without the leading '>' or '@'. */
+inline void read_name(std::string const& header, std::string& name) {
+    name.clear();
+    if (header.empty()) return;
+    uint64_t end = header.find_first_of(" \t\r");
+    if (end == std::string::npos) end = header.size();
+    name.assign(header, 1, end - 1);
+}
+
+/*
+    Query the k-mers of every record (FASTA with one sequence line, or FASTQ).
+    If out is not null, the read_result of every record is also written to out.
+*/
 template <typename Query>
-streaming_query_report streaming_query_from_fasta_file(dictionary const* dict, std::istream& is) {
+streaming_query_report streaming_query_from_records(dictionary const* dict, std::istream& is,
+                                                    bool fastq, std::ostream* out = nullptr,
+                                                    bool binary = false) {
+    static const uint64_t output_buffer_size = 1ULL << 20;
     streaming_query_report report;
-    std::string line;
     uint64_t k = dict->k();
     Query query(dict);
-    while (!is.eof()) {
+    fastx_reader reader(is, fastq);
+    read_result result;
+    std::string name;
+    std::string output;
+    while (reader.next()) {
         query.start();
-        std::getline(is, line);  // skip first header line
-        std::getline(is, line);
-        if (line.size() < k) continue;
-        for (uint64_t i = 0; i != line.size() - k + 1; ++i) {
-            char const* kmer = line.data() + i;
+        result.clear();
+        std::string_view sequence = reader.sequence();
+        for (uint64_t i = 0; i + k <= sequence.size(); ++i) {
+            char const* kmer = sequence.data() + i;
             auto answer = query.lookup_advanced(kmer);
             report.num_kmers += 1;
             report.num_positive_kmers += answer.kmer_id != constants::invalid_uint64;
+            if (out != nullptr) result.add(answer);
+        }
+        if (out != nullptr) {
+            if (!binary) read_name(reader.header(), name);
+            result.append_to(output, name, binary);
+            if (output.size() >= output_buffer_size) {
+                out->write(output.data(), output.size());
+                output.clear();
+            }
         }
     }
+    if (out != nullptr) out->write(output.data(), output.size());
     report.num_searches = query.num_searches();
     report.num_extensions = query.num_extensions();
     return report;
 }
 
+/*
+    A group of whole records: their DNA sequences are kept and, if requested,
+    also their names (the first word of the header).
+*/
+struct records_chunk {
+    records_chunk() : num_sequences(0), num_bases(0), sequence_number(0) {}
+
+    void clear() {
+        num_sequences = 0;
+        num_bases = 0;
+        output.clear();
+    }
+
+    std::string& next_sequence() {
+        if (num_sequences == sequences.size()) {
+            sequences.emplace_back();
+            names.emplace_back();
+        }
+        names[num_sequences].clear();
+        std::string& sequence = sequences[num_sequences++];
+        sequence.clear();
+        return sequence;
+    }
+
+    std::vector<std::string> sequences;  // only the first num_sequences are valid
+    std::vector<std::string> names;      // empty if names are not kept
+    uint64_t num_sequences;
+    uint64_t num_bases;
+
+    uint64_t sequence_number;  // position of the chunk in the input
+    std::string output;        // per-read results of the chunk
+};
+
+static const uint64_t num_bases_per_chunk = 1ULL << 20;
+
+/* Split a FASTA/FASTQ stream into chunks of whole records. */
+struct records_reader {
+    records_reader(std::istream& is, bool fastq, bool keep_names = false)
+        : m_reader(is, fastq), m_keep_names(keep_names) {}
+
+    /* Return false if no record is left. */
+    bool read(records_chunk& chunk) {
+        chunk.clear();
+        while (chunk.num_bases < num_bases_per_chunk and m_reader.next()) {
+            std::string& sequence = chunk.next_sequence();
+            sequence.assign(m_reader.sequence());
+            chunk.num_bases += sequence.size();
+            if (m_keep_names) read_name(m_reader.header(), chunk.names[chunk.num_sequences - 1]);
+        }
+        return chunk.num_sequences != 0;
+    }
+
+private:
+    fastx_reader m_reader;
+    bool m_keep_names;
+};
+
+/*
+    Split a multi-line FASTA stream into chunks as streaming_query_from_fasta_file_multiline
+    parses it: all the lines between two empty lines (headers included) form a single
+    sequence, whose k-mers span the line and record boundaries. A sequence that does not
+    fit into a chunk continues in the next one, starting with its last k-1 bases, so that
+    every k-mer is queried exactly once.
+*/
+struct multiline_reader {
+    multiline_reader(std::istream& is, uint64_t k) : m_lines(is), m_k(k) {}
+
+    /* Return false if the stream is exhausted. */
+    bool read(records_chunk& chunk) {
+        chunk.clear();
+        std::string* sequence = nullptr;
+        if (!m_overlap.empty()) {
+            sequence = &chunk.next_sequence();
+            sequence->swap(m_overlap);
+            m_overlap.clear();
+        }
+        std::string_view line;
+        while (chunk.num_bases < num_bases_per_chunk and m_lines.next(line)) {
+            if (line.empty()) { /* re-start the kmers' buffer */
+                sequence = nullptr;
+                continue;
+            }
+            if (sequence == nullptr) sequence = &chunk.next_sequence();
+            sequence->append(line);
+            chunk.num_bases += line.size();
+        }
+        if (sequence != nullptr and chunk.num_bases >= num_bases_per_chunk) {
+            uint64_t overlap = std::min<uint64_t>(sequence->size(), m_k - 1);
+            m_overlap.assign(*sequence, sequence->size() - overlap, overlap);
+        }
+        return chunk.num_sequences != 0;
+    }
+
+private:
+    line_reader m_lines;
+    uint64_t m_k;
+    std::string m_overlap;  // the last k-1 bases of an unfinished sequence
+};
+
+/*
+    One thread reads chunks of records while num_threads workers query them,
+    each with its own Query object. The reports of the workers are then merged.
+    Since the state of a Query is re-started at every record, the report is the same
+    as that of the sequential version. In multiline mode, the state is also re-started
+    at the beginning of every chunk, hence only num_searches and num_extensions may differ.
+    If out is not null (not in multiline mode), each worker also writes the read_result of
+    every record into the output buffer of its chunk and a writer thread flushes the chunks
+    to out in input order, so that the workers never synchronize on the output.
+    An exception thrown while reading the input is rethrown once all the threads are joined.
+*/
 template <typename Query>
-streaming_query_report streaming_query_from_fastq_file(dictionary const* dict, std::istream& is) {
-    streaming_query_report report;
-    std::string line;
-    uint64_t k = dict->k();
-    Query query(dict);
-    while (!is.eof()) {
-        query.start();
-        /* We assume the file is well-formed, i.e., there are exactly 4 lines per read. */
-        std::getline(is, line);  // skip first header line
-        std::getline(is, line);
-        if (line.size() >= k) {
-            for (uint64_t i = 0; i != line.size() - k + 1; ++i) {
-                char const* kmer = line.data() + i;
-                auto answer = query.lookup_advanced(kmer);
-                report.num_kmers += 1;
-                report.num_positive_kmers += answer.kmer_id != constants::invalid_uint64;
+streaming_query_report streaming_query_parallel(dictionary const* dict, std::istream& is,
+                                                bool fastq, bool multiline, uint64_t num_threads,
+                                                std::ostream* out = nullptr,
+                                                bool binary = false) {
+    assert(num_threads > 0);
+    assert(!multiline or out == nullptr);
+    uint64_t num_chunks = 2 * num_threads;
+    std::vector<records_chunk> chunks(num_chunks);
+    bounded_queue<uint64_t> free_chunks(num_chunks);
+    bounded_queue<uint64_t> full_chunks(num_chunks);
+    bounded_queue<uint64_t> done_chunks(num_chunks);
+    for (uint64_t i = 0; i != num_chunks; ++i) free_chunks.push(i);
+
+    std::exception_ptr reader_exception;
+    std::thread reader([&]() {
+        auto read_chunks = [&](auto& records) {
+            uint64_t id = 0;
+            uint64_t sequence_number = 0;
+            while (free_chunks.pop(id)) {
+                if (!records.read(chunks[id])) break;
+                chunks[id].sequence_number = sequence_number++;
+                full_chunks.push(id);
             }
+        };
+        try {
+            if (multiline) {
+                multiline_reader records(is, dict->k());
+                read_chunks(records);
+            } else {
+                records_reader records(is, fastq, out != nullptr and !binary);
+                read_chunks(records);
+            }
+        } catch (...) {
+            reader_exception = std::current_exception();
         }
-        std::getline(is, line);  // skip '+'
-        std::getline(is, line);  // skip score
+        full_chunks.close();
+    });
+
+    /*
+        At most num_chunks chunks are in flight, hence the chunk with sequence
+        number s can wait in pending[s % num_chunks] until all its predecessors
+        are written.
+    */
+    std::thread writer;
+    if (out != nullptr) {
+        writer = std::thread([&]() {
+            std::vector<uint64_t> pending(num_chunks, constants::invalid_uint64);
+            uint64_t next = 0;
+            uint64_t id = 0;
+            while (done_chunks.pop(id)) {
+                pending[chunks[id].sequence_number % num_chunks] = id;
+                while (pending[next % num_chunks] != constants::invalid_uint64) {
+                    uint64_t& ready = pending[next % num_chunks];
+                    out->write(chunks[ready].output.data(), chunks[ready].output.size());
+                    free_chunks.push(ready);
+                    ready = constants::invalid_uint64;
+                    ++next;
+                }
+            }
+        });
+    }
+
+    std::vector<streaming_query_report> reports(num_threads);
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads);
+    for (uint64_t t = 0; t != num_threads; ++t) {
+        workers.emplace_back([&, t]() {
+            streaming_query_report& report = reports[t];
+            uint64_t k = dict->k();
+            Query query(dict);
+            read_result result;
+            uint64_t id = 0;
+            while (full_chunks.pop(id)) {
+                records_chunk& chunk = chunks[id];
+                for (uint64_t i = 0; i != chunk.num_sequences; ++i) {
+                    std::string const& sequence = chunk.sequences[i];
+                    query.start();
+                    result.clear();
+                    if (sequence.size() >= k) {
+                        for (uint64_t j = 0; j != sequence.size() - k + 1; ++j) {
+                            char const* kmer = sequence.data() + j;
+                            auto answer = query.lookup_advanced(kmer);
+                            report.num_kmers += 1;
+                            report.num_positive_kmers +=
+                                answer.kmer_id != constants::invalid_uint64;
+                            if (out != nullptr) result.add(answer);
+                        }
+                    }
+                    if (out != nullptr) result.append_to(chunk.output, chunk.names[i], binary);
+                }
+                if (out != nullptr) {
+                    done_chunks.push(id);
+                } else {
+                    free_chunks.push(id);
+                }
+            }
+            report.num_searches = query.num_searches();
+            report.num_extensions = query.num_extensions();
+        });
+    }
+
+    reader.join();
+    for (auto& worker : workers) worker.join();
+    if (out != nullptr) {
+        done_chunks.close();
+        writer.join();
+    }
+    if (reader_exception) std::rethrow_exception(reader_exception);
+
+    streaming_query_report report;
+    for (auto const& r : reports) {
+        report.num_kmers += r.num_kmers;
+        report.num_positive_kmers += r.num_positive_kmers;
+        report.num_searches += r.num_searches;
+        report.num_extensions += r.num_extensions;
     }
-    report.num_searches = query.num_searches();
-    report.num_extensions = query.num_extensions();
     return report;
 }
 
 template <typename Query>
-streaming_query_report streaming_query_from_fasta_file(dictionary const* dict, std::istream& is,
-                                                       bool multiline) {
+streaming_query_report streaming_query(dictionary const* dict, std::istream& is, bool fastq,
+                                       bool multiline, uint64_t num_threads, std::ostream* out,
+                                       bool binary) {
+    if (num_threads > 1) {
+        return streaming_query_parallel<Query>(dict, is, fastq, multiline, num_threads, out,
+                                               binary);
+    }
     if (multiline) return streaming_query_from_fasta_file_multiline<Query>(dict, is);
-    return streaming_query_from_fasta_file<Query>(dict, is);
+    return streaming_query_from_records<Query>(dict, is, fastq, out, binary);
 }
 
 streaming_query_report dictionary::streaming_query_from_file(std::string const& filename,
-                                                             bool multiline) const {
+                                                             bool multiline,
+                                                             uint64_t num_threads) const {
+    return streaming_query_from_file(filename, multiline, num_threads, nullptr, false);
+}
+
+streaming_query_report dictionary::streaming_query_from_file(std::string const& filename,
+                                                             bool multiline, uint64_t num_threads,
+                                                             std::ostream* out,
+                                                             bool binary) const {
+    bool gzipped = util::ends_with(filename, ".gz");
+    std::string name = gzipped ? filename.substr(0, filename.size() - 3) : filename;
+    bool fasta = util::ends_with(name, ".fa") or util::ends_with(name, ".fasta");
+    bool fastq = util::ends_with(name, ".fq") or util::ends_with(name, ".fastq");
+    if (!fasta and !fastq) {
+        std::cerr << "unsupported query file format" << std::endl;
+        return streaming_query_report();
+    }
+    if (fastq and multiline) {
+        std::cout << "==> Warning: option 'multiline' is only valid for FASTA files, not FASTQ."
+                  << std::endl;
+        multiline = false;
+    }
+    if (multiline and out != nullptr) {
+        throw std::runtime_error(
+            "per-read output is not available in multiline mode: a k-mer may span two records");
+    }
+
     std::ifstream is(filename.c_str());
     if (!is.good()) throw std::runtime_error("error in opening the file '" + filename + "'");
     streaming_query_report report;
 
-    if (util::ends_with(filename, ".fa.gz") or util::ends_with(filename, ".fasta.gz")) {
-        zip_istream zis(is);
-
-        if (canonicalized()) {
-            report = streaming_query_from_fasta_file<streaming_query_canonical_parsing>(this, zis,
-                                                                                        multiline);
-        } else {
-            report = streaming_query_from_fasta_file<streaming_query_regular_parsing>(this, zis,
-                                                                                      multiline);
-        }
-
-    } else if (util::ends_with(filename, ".fq.gz") or util::ends_with(filename, ".fastq.gz")) {
-        if (multiline) {
-            std::cout << "==> Warning: option 'multiline' is only valid for FASTA files, not FASTQ."
-                      << std::endl;
-        }
-        zip_istream zis(is);
-
+    auto run = [&](std::istream& input) {
         if (canonicalized()) {
-            report = streaming_query_from_fastq_file<streaming_query_canonical_parsing>(this, zis);
+            report = streaming_query<streaming_query_canonical_parsing>(
+                this, input, fastq, multiline, num_threads, out, binary);
         } else {
-            report = streaming_query_from_fastq_file<streaming_query_regular_parsing>(this, zis);
-        }
-
-    } else if (util::ends_with(filename, ".fa") or util::ends_with(filename, ".fasta")) {
-        if (canonicalized()) {
-            report = streaming_query_from_fasta_file<streaming_query_canonical_parsing>(this, is,
-                                                                                        multiline);
-        } else {
-            report = streaming_query_from_fasta_file<streaming_query_regular_parsing>(this, is,
-                                                                                      multiline);
-        }
-
-    } else if (util::ends_with(filename, ".fq") or util::ends_with(filename, ".fastq")) {
-        if (multiline) {
-            std::cout << "==> Warning: option 'multiline' is only valid for FASTA files, not FASTQ."
-                      << std::endl;
-        }
-        if (canonicalized()) {
-            report = streaming_query_from_fastq_file<streaming_query_canonical_parsing>(this, is);
-        } else {
-            report = streaming_query_from_fastq_file<streaming_query_regular_parsing>(this, is);
+            report = streaming_query<streaming_query_regular_parsing>(
+                this, input, fastq, multiline, num_threads, out, binary);
         }
+    };
 
+    if (gzipped) {
+        threaded_zip_istream zis(filename, num_threads);
+        run(zis);
     } else {
-        std::cerr << "unsupported query file format" << std::endl;
+        run(is);
     }
 
     is.close();
     return report;
 }
 
-}  // namespace sshash
\ No newline at end of file
+}  // namespace sshash
@@ -67,6 +67,14 @@ struct streaming_query_canonical_parsing {
         assert(minimizer_rc == util::compute_minimizer(m_kmer_rc, m_k, m_m, m_seed));
         m_curr_minimizer = std::min<uint64_t>(m_curr_minimizer, minimizer_rc);
 
+        /* the filter rules out most of the absent k-mers without locating a bucket */
+        if (!m_dict->m_filter.contains(std::min(m_kmer, m_kmer_rc))) {
+            forget_bucket();
+            m_start = false;
+            assert(equal_lookup_result(m_dict->lookup_advanced(kmer), m_res));
+            return m_res;
+        }
+
         /* 3. compute result */
         if (m_start) {
             locate_bucket();
@@ -129,6 +137,19 @@ private:
 
     inline bool same_minimizer() const { return m_curr_minimizer == m_prev_minimizer; }
 
+    /*
+        Forget the result and the bucket of the previous k-mer, so that the next k-mer
+        is neither extended nor looked up in a cached bucket, but searched from scratch.
+    */
+    void forget_bucket() {
+        m_res = lookup_result();
+        m_reverse = false;
+        m_pos_in_window = 0;
+        m_window_size = 0;
+        m_minimizer_not_found = false;
+        m_prev_minimizer = constants::invalid_uint64;
+    }
+
     void locate_bucket() {
         uint64_t bucket_id = (m_dict->m_minimizers).lookup(m_curr_minimizer);
         std::tie(m_begin, m_end) = (m_dict->m_buckets).locate_bucket(bucket_id);
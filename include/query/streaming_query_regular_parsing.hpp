@@ -70,6 +70,14 @@ struct streaming_query_regular_parsing {
         m_curr_minimizer_rc = m_minimizer_enum_rc.next<reverse>(m_kmer_rc, m_start);
         assert(m_curr_minimizer_rc == util::compute_minimizer(m_kmer_rc, m_k, m_m, m_seed));
 
+        /* the filter rules out most of the absent k-mers without locating a bucket */
+        if (!m_dict->m_filter.contains(m_kmer) and !m_dict->m_filter.contains(m_kmer_rc)) {
+            forget_bucket();
+            m_start = false;
+            assert(equal_lookup_result(m_dict->lookup_advanced(kmer), m_res));
+            return m_res;
+        }
+
         bool both_minimizers_not_found = (same_minimizer() and m_minimizer_not_found) and
                                          (same_minimizer_rc() and m_minimizer_rc_not_found);
         if (both_minimizers_not_found) {
@@ -162,6 +170,21 @@ private:
         m_start = false;
     }
 
+    /*
+        Forget the result and the bucket of the previous k-mer, so that the next k-mer
+        is neither extended nor looked up in a cached bucket, but searched from scratch.
+    */
+    void forget_bucket() {
+        m_res = lookup_result();
+        m_reverse = false;
+        m_pos_in_window = 0;
+        m_window_size = 0;
+        m_minimizer_not_found = false;
+        m_minimizer_rc_not_found = false;
+        m_prev_minimizer = constants::invalid_uint64;
+        m_prev_minimizer_rc = constants::invalid_uint64;
+    }
+
     inline bool found() { return m_res.kmer_id != constants::invalid_uint64; }
     inline bool same_minimizer() const { return m_curr_minimizer == m_prev_minimizer; }
     inline bool same_minimizer_rc() const { return m_curr_minimizer_rc == m_prev_minimizer_rc; }
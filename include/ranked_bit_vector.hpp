@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+
+namespace sshash {
+
+/*
+    A bit vector with rank support. Every block of 512 bits is preceded by the number of
+    ones in the blocks before it, so that reading a bit and its rank touches a single
+    block of 72 bytes.
+*/
+struct ranked_bit_vector {
+    static constexpr uint64_t block_size = 512;  // in bits
+    static constexpr uint64_t words_per_block = block_size / 64;
+
+    ranked_bit_vector() : m_size(0), m_num_ones(0) {}
+
+    /* Build from the bits bit(0), bit(1), ..., bit(n-1). */
+    template <typename Predicate>
+    void build(uint64_t n, Predicate bit) {
+        m_size = n;
+        m_num_ones = 0;
+        uint64_t num_blocks = (n + block_size - 1) / block_size;
+        m_data.assign(num_blocks * (1 + words_per_block), 0);
+        for (uint64_t i = 0; i != n; ++i) {
+            uint64_t* block = m_data.data() + (i / block_size) * (1 + words_per_block);
+            if (i % block_size == 0) block[0] = m_num_ones;
+            if (bit(i)) {
+                block[1 + (i % block_size) / 64] |= uint64_t(1) << (i % 64);
+                ++m_num_ones;
+            }
+        }
+    }
+
+    bool empty() const { return m_size == 0; }
+    uint64_t size() const { return m_size; }
+    uint64_t num_ones() const { return m_num_ones; }
+
+    /* Return the i-th bit and the number of ones before position i. */
+    std::pair<bool, uint64_t> access_and_rank(uint64_t i) const {
+        assert(i < size());
+        uint64_t const* block = m_data.data() + (i / block_size) * (1 + words_per_block);
+        uint64_t word = (i % block_size) / 64;
+        uint64_t rank = block[0];
+        for (uint64_t w = 0; w != word; ++w) rank += __builtin_popcountll(block[1 + w]);
+        uint64_t bits = block[1 + word];
+        uint64_t shift = i % 64;
+        rank += __builtin_popcountll(bits & ((uint64_t(1) << shift) - 1));
+        return {(bits >> shift) & 1, rank};
+    }
+
+    void swap(ranked_bit_vector& other) {
+        std::swap(m_size, other.m_size);
+        std::swap(m_num_ones, other.m_num_ones);
+        m_data.swap(other.m_data);
+    }
+
+    void prefetch(uint64_t i) const {
+        __builtin_prefetch(m_data.data() + (i / block_size) * (1 + words_per_block));
+    }
+
+    uint64_t num_bits() const {
+        return 8 * (sizeof(m_size) + sizeof(m_num_ones) + sizeof(size_t) +
+                    m_data.size() * sizeof(uint64_t));
+    }
+
+    template <typename Visitor>
+    void visit(Visitor& visitor) {
+        visitor.visit(m_size);
+        visitor.visit(m_num_ones);
+        visitor.visit(m_data);
+    }
+
+private:
+    uint64_t m_size;
+    uint64_t m_num_ones;
+    std::vector<uint64_t> m_data;
+};
+
+}  // namespace sshash
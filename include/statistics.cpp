@@ -1,4 +1,5 @@
 #include "dictionary.hpp"
+#include "minimizer_enumerator.hpp"
 #include "buckets_statistics.hpp"
 
 namespace sshash {
@@ -6,12 +7,15 @@ namespace sshash {
 void dictionary::compute_statistics() const {
     uint64_t num_kmers = size();
     uint64_t num_minimizers = m_minimizers.size();
-    uint64_t num_super_kmers = m_buckets.offsets.size();
+    uint64_t num_super_kmers = m_buckets.num_super_kmers();
 
     buckets_statistics buckets_stats(num_minimizers, num_kmers, num_super_kmers);
 
     std::cout << "computing buckets statistics..." << std::endl;
 
+    minimizer_enumerator<> minimizer_enum(m_k, m_m, m_seed);
+    minimizer_enumerator<> minimizer_enum_rc(m_k, m_m, m_seed);
+
     for (uint64_t bucket_id = 0; bucket_id != num_minimizers; ++bucket_id) {
         auto [begin, end] = m_buckets.locate_bucket(bucket_id);
         uint64_t num_super_kmers_in_bucket = end - begin;
@@ -26,15 +30,12 @@ void dictionary::compute_statistics() const {
             uint64_t w = 0;
             for (; w != window_size; ++w) {
                 uint64_t kmer = bv_it.read_and_advance_by_two(2 * m_k);
-                auto [minimizer, pos] = util::compute_minimizer_pos(kmer, m_k, m_m, m_seed);
+                uint64_t minimizer = minimizer_enum.next(kmer, w == 0);
                 if (m_canonical_parsing) {
                     uint64_t kmer_rc = util::compute_reverse_complement(kmer, m_k);
-                    auto [minimizer_rc, pos_rc] =
-                        util::compute_minimizer_pos(kmer_rc, m_k, m_m, m_seed);
-                    if (minimizer_rc < minimizer) {
-                        minimizer = minimizer_rc;
-                        pos = pos_rc;
-                    }
+                    constexpr bool reverse = true;
+                    uint64_t minimizer_rc = minimizer_enum_rc.next<reverse>(kmer_rc, w == 0);
+                    minimizer = std::min<uint64_t>(minimizer, minimizer_rc);
                 }
                 if (prev_minimizer != constants::invalid_uint64 and minimizer != prev_minimizer) {
                     break;
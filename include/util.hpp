@@ -3,6 +3,9 @@
 #include <vector>
 #include <cassert>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <cmath>  // for std::ceil on linux
 
 #include "hash_util.hpp"
@@ -45,6 +48,22 @@ struct neighbourhood {
     lookup_result backward_T;
 };
 
+/* A range [contig_begin, contig_end) of whole contigs, whose k-mers have ids in
+   [kmer_begin, kmer_end). */
+struct contig_range {
+    uint64_t contig_begin, contig_end;
+    uint64_t kmer_begin, kmer_end;
+};
+
+/* A contig as a span [begin, end) of positions (in bases) of the 2-bit encoded strings:
+   its k-mers start at begin, begin + 1, ..., end - k and have ids kmer_id, kmer_id + 1, etc. */
+struct contig_span {
+    uint64_t contig_id;
+    uint64_t kmer_id;  // id of the first k-mer
+    uint64_t begin;
+    uint64_t end;
+};
+
 [[maybe_unused]] static bool equal_lookup_result(lookup_result expected, lookup_result got) {
     bool good = true;
     if (expected.kmer_id != got.kmer_id) {
@@ -88,6 +107,11 @@ struct build_configuration {
         , canonical_parsing(false)
         , weighted(false)
         , verbose(true)
+        , num_threads(1)
+        , ram(constants::default_ram)
+        , filter_bits_per_kmer(0)
+        , locality_layout(false)
+        , singleton_split(false)
 
         , tmp_dirname(constants::default_tmp_dirname) {}
 
@@ -101,6 +125,11 @@ struct build_configuration {
     bool canonical_parsing;
     bool weighted;
     bool verbose;
+    uint64_t num_threads;
+    uint64_t ram;  // in bytes
+    uint64_t filter_bits_per_kmer;  // 0 means no filter
+    bool locality_layout;           // see buckets::build_locality_layout
+    bool singleton_split;           // see buckets::build_singleton_split
 
     std::string tmp_dirname;
 
@@ -108,7 +137,12 @@ struct build_configuration {
         std::cout << "k = " << k << ", m = " << m << ", seed = " << seed << ", l = " << l
                   << ", c = " << c
                   << ", canonical_parsing = " << (canonical_parsing ? "true" : "false")
-                  << ", weighted = " << (weighted ? "true" : "false") << std::endl;
+                  << ", weighted = " << (weighted ? "true" : "false")
+                  << ", num_threads = " << num_threads
+                  << ", ram = " << static_cast<double>(ram) / essentials::GB << " [GB]"
+                  << ", filter_bits_per_kmer = " << filter_bits_per_kmer
+                  << ", locality_layout = " << (locality_layout ? "true" : "false")
+                  << ", singleton_split = " << (singleton_split ? "true" : "false") << std::endl;
     }
 };
 
@@ -412,6 +446,23 @@ static inline std::istream& appendline(std::istream& is, std::string& str, char
     return is;
 }
 
+/* Call f(i) for all i in [0, n) with num_threads threads, taking indexes dynamically. */
+template <typename Function>
+void parallel_for(uint64_t n, uint64_t num_threads, Function f) {
+    if (num_threads <= 1 or n <= 1) {
+        for (uint64_t i = 0; i != n; ++i) f(i);
+        return;
+    }
+    std::atomic<uint64_t> next(0);
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t != std::min(num_threads, n); ++t) {
+        threads.emplace_back([&]() {
+            for (uint64_t i = next++; i < n; i = next++) f(i);
+        });
+    }
+    for (auto& t : threads) t.join();
+}
+
 struct buffered_lines_iterator {
     static const uint64_t BUFFER_SIZE = 1024;
 
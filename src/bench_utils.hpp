@@ -1,19 +1,73 @@
 #pragma once
 
+#include <fstream>
+#include <random>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "../include/query/streaming_query.hpp"
+#include "../include/perf_counters.hpp"
+
 namespace sshash {
 
 void perf_test_iterator(dictionary const& dict) {
-    essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
-    t.start();
-    auto it = dict.begin();
-    while (it.has_next()) {
-        auto [kmer_id, kmer] = it.next();
-        essentials::do_not_optimize_away(kmer_id);
-        essentials::do_not_optimize_away(kmer[0]);
+    double avg_nanosec = 0;
+    {
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
+        t.start();
+        auto it = dict.begin();
+        while (it.has_next()) {
+            auto [kmer_id, kmer] = it.next();
+            essentials::do_not_optimize_away(kmer_id);
+            essentials::do_not_optimize_away(kmer[0]);
+        }
+        t.stop();
+        avg_nanosec = t.elapsed() / dict.size();
+        std::cout << "iterator: avg_nanosec_per_kmer " << avg_nanosec << std::endl;
+    }
+    {
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
+        t.start();
+        auto uint_it = dict.begin_uint();
+        while (uint_it.has_next()) {
+            auto [kmer_id, uint_kmer] = uint_it.next();
+            essentials::do_not_optimize_away(kmer_id);
+            essentials::do_not_optimize_away(uint_kmer);
+        }
+        t.stop();
+        avg_nanosec = t.elapsed() / dict.size();
+        std::cout << "uint_iterator: avg_nanosec_per_kmer " << avg_nanosec << std::endl;
+    }
+    {
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
+        t.start();
+        kmer_t checksum = 0;
+        dict.for_each_kmer([&](uint64_t, kmer_t uint_kmer) { checksum ^= uint_kmer; });
+        essentials::do_not_optimize_away(checksum);
+        t.stop();
+        avg_nanosec = t.elapsed() / dict.size();
+        std::cout << "for_each_kmer: avg_nanosec_per_kmer " << avg_nanosec << std::endl;
+    }
+    {
+        uint64_t num_threads = std::max<uint64_t>(1, std::thread::hardware_concurrency());
+        std::vector<kmer_t> checksums(num_threads * 4, 0);
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
+        t.start();
+        auto ranges = dict.partition(checksums.size());
+        parallel_for(ranges.size(), num_threads, [&](uint64_t i) {
+            kmer_t checksum = 0;
+            dict.for_each_kmer(ranges[i],
+                               [&](uint64_t, kmer_t uint_kmer) { checksum ^= uint_kmer; });
+            checksums[i] = checksum;
+        });
+        essentials::do_not_optimize_away(checksums.front());
+        t.stop();
+        avg_nanosec = t.elapsed() / dict.size();
+        std::cout << "for_each_kmer (" << num_threads
+                  << " threads): avg_nanosec_per_kmer " << avg_nanosec << std::endl;
     }
-    t.stop();
-    double avg_nanosec = t.elapsed() / dict.size();
-    std::cout << "iterator: avg_nanosec_per_kmer " << avg_nanosec << std::endl;
 }
 
 void perf_test_lookup_access(dictionary const& dict) {
@@ -118,6 +172,50 @@ void perf_test_lookup_access(dictionary const& dict) {
         double nanosec_per_lookup = t.elapsed() / (runs * lookup_queries.size());
         std::cout << "avg_nanosec_per_negative_lookup_advanced " << nanosec_per_lookup << std::endl;
     }
+    {
+        // perf test positive lookup_batch
+        std::vector<kmer_t> lookup_queries;
+        lookup_queries.reserve(num_queries);
+        for (uint64_t i = 0; i != num_queries; ++i) {
+            uint64_t id = distr.gen();
+            dict.access(id, kmer.data());
+            kmer_t uint_kmer = util::string_to_uint_kmer_no_reverse(kmer.data(), k);
+            if ((i & 1) == 0) {
+                /* transform 50% of the kmers into their reverse complements */
+                uint_kmer = util::compute_reverse_complement(uint_kmer, k);
+            }
+            lookup_queries.push_back(uint_kmer);
+        }
+        std::vector<lookup_result> results(lookup_queries.size());
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
+        t.start();
+        for (uint64_t r = 0; r != runs; ++r) {
+            dict.lookup_batch(lookup_queries.data(), lookup_queries.size(), results.data());
+            essentials::do_not_optimize_away(results.back().kmer_id);
+        }
+        t.stop();
+        double nanosec_per_lookup = t.elapsed() / (runs * lookup_queries.size());
+        std::cout << "avg_nanosec_per_positive_lookup_batch " << nanosec_per_lookup << std::endl;
+    }
+    {
+        // perf test negative lookup_batch
+        std::vector<kmer_t> lookup_queries;
+        lookup_queries.reserve(num_queries);
+        for (uint64_t i = 0; i != num_queries; ++i) {
+            random_kmer(kmer.data(), k);
+            lookup_queries.push_back(util::string_to_uint_kmer_no_reverse(kmer.data(), k));
+        }
+        std::vector<lookup_result> results(lookup_queries.size());
+        essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
+        t.start();
+        for (uint64_t r = 0; r != runs; ++r) {
+            dict.lookup_batch(lookup_queries.data(), lookup_queries.size(), results.data());
+            essentials::do_not_optimize_away(results.back().kmer_id);
+        }
+        t.stop();
+        double nanosec_per_lookup = t.elapsed() / (runs * lookup_queries.size());
+        std::cout << "avg_nanosec_per_negative_lookup_batch " << nanosec_per_lookup << std::endl;
+    }
     {
         // perf test access
         std::vector<uint64_t> access_queries;
@@ -179,4 +277,342 @@ void perf_test_lookup_weight(dictionary const& dict) {
     std::cout << "avg_nanosec_per_positive_lookup_with_weight " << nanosec_per_lookup << std::endl;
 }
 
-}  // namespace sshash
\ No newline at end of file
+/*
+    Log-linear histogram of latencies in nanoseconds, as in HdrHistogram: exact below 32,
+    then 16 buckets per power of two, so that a latency is reported within 1/16 of its value.
+*/
+struct latency_histogram {
+    latency_histogram() : m_counts(32 + 16 * (64 - 5), 0), m_total(0), m_max(0) {}
+
+    void add(uint64_t nanosec) {
+        m_counts[index(nanosec)] += 1;
+        m_total += 1;
+        if (nanosec > m_max) m_max = nanosec;
+    }
+
+    uint64_t total() const { return m_total; }
+    uint64_t max() const { return m_max; }
+
+    /* The smallest latency l such that a fraction q of the samples is <= l. */
+    uint64_t percentile(double q) const {
+        uint64_t target = std::max<uint64_t>(1, std::ceil(q * m_total));
+        uint64_t count = 0;
+        for (uint64_t i = 0; i != m_counts.size(); ++i) {
+            count += m_counts[i];
+            if (count >= target) return std::min(upper(i), m_max);
+        }
+        return m_max;
+    }
+
+    void print_json(std::ostream& os) const {
+        os << "{\"count\": " << m_total << ", \"p50\": " << percentile(0.5)
+           << ", \"p99\": " << percentile(0.99) << ", \"p999\": " << percentile(0.999)
+           << ", \"max\": " << m_max << ", \"buckets\": [";
+        bool first = true;
+        for (uint64_t i = 0; i != m_counts.size(); ++i) {
+            if (m_counts[i] == 0) continue;
+            os << (first ? "" : ", ") << "[" << lower(i) << ", " << upper(i) << ", "
+               << m_counts[i] << "]";
+            first = false;
+        }
+        os << "]}";
+    }
+
+private:
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total;
+    uint64_t m_max;
+
+    static uint64_t index(uint64_t x) {
+        if (x < 32) return x;
+        uint64_t e = 63 - __builtin_clzll(x);
+        return 32 + (e - 5) * 16 + ((x >> (e - 4)) & 15);
+    }
+    static uint64_t lower(uint64_t i) {
+        if (i < 32) return i;
+        uint64_t e = (i - 32) / 16 + 5;
+        return (16 + (i - 32) % 16) << (e - 4);
+    }
+    static uint64_t upper(uint64_t i) {
+        return i + 1 == 32 + 16 * (64 - 5) ? uint64_t(-1) : lower(i + 1) - 1;
+    }
+};
+
+/* Time-stamp counter (or, if not available, a nanosecond clock) to time single lookups. */
+inline uint64_t read_ticks() {
+#if defined(__x86_64__)
+    _mm_lfence();
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
+
+/* Ticks per nanosecond, measured against the high resolution clock. */
+double ticks_per_nanosec() {
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t ticks_start = read_ticks();
+    while (std::chrono::high_resolution_clock::now() - start < std::chrono::milliseconds(100)) {}
+    uint64_t ticks = read_ticks() - ticks_start;
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::high_resolution_clock::now() - start);
+    return static_cast<double>(ticks) / elapsed.count();
+}
+
+/*
+    Time every single lookup of positive and negative k-mers and report the latency
+    distribution, overall and per class of the bucket the k-mer is looked up in
+    (see dictionary::bucket_class). A positive k-mer is classified as it is stored in the
+    dictionary, before half of them are turned into their reverse complements: the lookups
+    check both strands, so with regular parsing they probe the buckets of both anyway, and
+    the class is the costlier of the two. If json_filename is not empty, the histograms
+    are also written there.
+*/
+void perf_test_lookup_latency(dictionary const& dict, std::string const& json_filename) {
+    constexpr uint64_t num_queries = 1000000;
+    essentials::uniform_int_rng<uint64_t> distr(0, dict.size() - 1, essentials::get_random_seed());
+    uint64_t k = dict.k();
+    std::string kmer(k, 0);
+
+    double tpns = ticks_per_nanosec();
+    uint64_t timer_overhead = -1;  // in ticks
+    for (uint64_t i = 0; i != 1000; ++i) {
+        uint64_t start = read_ticks();
+        timer_overhead = std::min(timer_overhead, read_ticks() - start);
+    }
+
+    auto class_name = [](uint64_t bucket_class) {
+        if (bucket_class == 0) return std::string("singleton");
+        if (bucket_class == 1) return std::string("linear_scan");
+        return "skew_partition_" + std::to_string(bucket_class - 2);
+    };
+
+    auto run = [&](std::vector<kmer_t> const& queries, std::vector<uint64_t> const& classes) {
+        std::vector<latency_histogram> histograms(1);  // histograms[0] is for all queries
+        for (uint64_t i = 0; i != queries.size(); ++i) {
+            uint64_t start = read_ticks();
+            auto res = dict.lookup_advanced_uint(queries[i]);
+            uint64_t ticks = read_ticks() - start;
+            essentials::do_not_optimize_away(res.kmer_id);
+            ticks = ticks > timer_overhead ? ticks - timer_overhead : 0;
+            uint64_t nanosec = ticks / tpns;
+            if (classes[i] + 1 >= histograms.size()) histograms.resize(classes[i] + 2);
+            histograms[0].add(nanosec);
+            histograms[classes[i] + 1].add(nanosec);
+        }
+        return histograms;
+    };
+
+    auto print = [&](std::vector<latency_histogram> const& histograms, char const* name) {
+        for (uint64_t i = 0; i != histograms.size(); ++i) {
+            auto const& h = histograms[i];
+            if (h.total() == 0) continue;
+            std::cout << name << "_lookup_latency [" << (i == 0 ? "all" : class_name(i - 1))
+                      << "]: count " << h.total() << ", p50 " << h.percentile(0.5) << ", p99 "
+                      << h.percentile(0.99) << ", p999 " << h.percentile(0.999) << ", max "
+                      << h.max() << " [nanosec]" << std::endl;
+        }
+    };
+
+    std::vector<latency_histogram> positive, negative;
+    {
+        std::vector<kmer_t> queries;
+        std::vector<uint64_t> classes;
+        queries.reserve(num_queries);
+        classes.reserve(num_queries);
+        for (uint64_t i = 0; i != num_queries; ++i) {
+            dict.access(distr.gen(), kmer.data());
+            kmer_t uint_kmer = util::string_to_uint_kmer_no_reverse(kmer.data(), k);
+            classes.push_back(dict.bucket_class(uint_kmer));
+            if ((i & 1) == 0) {
+                /* transform 50% of the kmers into their reverse complements */
+                uint_kmer = util::compute_reverse_complement(uint_kmer, k);
+            }
+            queries.push_back(uint_kmer);
+        }
+        positive = run(queries, classes);
+        print(positive, "positive");
+    }
+    {
+        std::vector<kmer_t> queries;
+        std::vector<uint64_t> classes;
+        queries.reserve(num_queries);
+        classes.reserve(num_queries);
+        for (uint64_t i = 0; i != num_queries; ++i) {
+            random_kmer(kmer.data(), k);
+            kmer_t uint_kmer = util::string_to_uint_kmer_no_reverse(kmer.data(), k);
+            classes.push_back(dict.bucket_class(uint_kmer));
+            queries.push_back(uint_kmer);
+        }
+        negative = run(queries, classes);
+        print(negative, "negative");
+    }
+
+    if (json_filename.empty()) return;
+    std::ofstream out(json_filename.c_str());
+    if (!out.is_open()) throw std::runtime_error("cannot open file '" + json_filename + "'");
+    auto write = [&](std::vector<latency_histogram> const& histograms) {
+        out << "{";
+        bool first = true;
+        for (uint64_t i = 0; i != histograms.size(); ++i) {
+            if (histograms[i].total() == 0) continue;
+            out << (first ? "\n    " : ",\n    ") << "\""
+                << (i == 0 ? "all" : class_name(i - 1)) << "\": ";
+            histograms[i].print_json(out);
+            first = false;
+        }
+        out << "\n  }";
+    };
+    out << "{\n  \"k\": " << k << ",\n  \"m\": " << dict.m()
+        << ",\n  \"canonical_parsing\": " << (dict.canonicalized() ? "true" : "false")
+        << ",\n  \"ticks_per_nanosec\": " << tpns << ",\n  \"positive\": ";
+    write(positive);
+    out << ",\n  \"negative\": ";
+    write(negative);
+    out << "\n}\n";
+    out.close();
+}
+
+/*
+    Synthesize num_reads reads of read_length bases from the dictionary itself and
+    run the streaming query over them. A positive read is a walk along a contig (in
+    either orientation) that starts at a random k-mer, with every base substituted
+    with probability error_rate; a fraction negative_fraction of the reads are random
+    bases instead.
+*/
+template <typename Query>
+void perf_test_streaming_query(dictionary const& dict, uint64_t num_reads, uint64_t read_length,
+                               double error_rate, double negative_fraction) {
+    uint64_t k = dict.k();
+    if (read_length < k) read_length = k;
+    std::mt19937_64 rng(essentials::get_random_seed());
+    std::uniform_int_distribution<uint64_t> kmer_ids(0, dict.size() - 1);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::uniform_int_distribution<uint64_t> bases(0, 3);
+
+    std::vector<std::string> reads(num_reads);
+    uint64_t num_kmers_in_reads = 0;
+    std::string kmer(k, 0);
+    for (auto& read : reads) {
+        if (coin(rng) < negative_fraction) {
+            read.resize(read_length);
+            for (auto& c : read) c = "ACGT"[bases(rng)];
+        } else {
+            uint64_t kmer_id = kmer_ids(rng);
+            dict.access(kmer_id, kmer.data());
+            auto res = dict.lookup_advanced(kmer.c_str());
+            assert(res.kmer_id == kmer_id);
+            /* walk along the contig, without leaving it: each k-mer adds its last base */
+            uint64_t num_kmers = std::min(read_length - k + 1,
+                                          res.contig_size - res.kmer_id_in_contig);
+            read = kmer;
+            auto it = dict.at_uint(kmer_id);
+            it.next();
+            for (uint64_t i = 1; i != num_kmers; ++i) {
+                assert(it.has_next());
+                kmer_t uint_kmer = it.next().second;
+                read.push_back(util::uint64_to_char(uint64_t(uint_kmer >> (2 * (k - 1))) & 3));
+            }
+            if (coin(rng) < 0.5) {
+                std::string read_rc(read.size(), 0);
+                util::compute_reverse_complement(read.data(), read_rc.data(), read.size());
+                read.swap(read_rc);
+            }
+            for (auto& c : read) {
+                if (coin(rng) >= error_rate) continue;
+                char substitution = c;
+                while (substitution == c) substitution = "ACGT"[bases(rng)];
+                c = substitution;
+            }
+        }
+        num_kmers_in_reads += read.size() - k + 1;
+    }
+
+    streaming_query_report report;
+    Query query(&dict);
+    essentials::timer<std::chrono::high_resolution_clock, std::chrono::nanoseconds> t;
+    t.start();
+    for (auto const& read : reads) {
+        query.start();
+        for (uint64_t i = 0; i != read.size() - k + 1; ++i) {
+            auto answer = query.lookup_advanced(read.data() + i);
+            report.num_positive_kmers += answer.kmer_id != constants::invalid_uint64;
+        }
+    }
+    t.stop();
+    report.num_kmers = num_kmers_in_reads;
+    report.num_searches = query.num_searches();
+    report.num_extensions = query.num_extensions();
+
+    std::cout << "streaming_query (" << num_reads << " reads of " << read_length
+              << " bases, error_rate = " << error_rate
+              << ", negative_fraction = " << negative_fraction << "):\n";
+    /* percentage of x over y, 0 if y is 0 (e.g., no positive k-mer with many errors) */
+    auto percentage = [](uint64_t x, uint64_t y) { return y != 0 ? (x * 100.0) / y : 0.0; };
+    std::cout << "  num_kmers = " << report.num_kmers << "\n";
+    std::cout << "  num_positive_kmers = " << report.num_positive_kmers << " ("
+              << percentage(report.num_positive_kmers, report.num_kmers) << "%)\n";
+    std::cout << "  num_searches = " << report.num_searches << "/" << report.num_positive_kmers
+              << " (" << percentage(report.num_searches, report.num_positive_kmers) << "%)\n";
+    std::cout << "  num_extensions = " << report.num_extensions << "/"
+              << report.num_positive_kmers << " ("
+              << percentage(report.num_extensions, report.num_positive_kmers) << "%)\n";
+    std::cout << "  avg_nanosec_per_kmer " << static_cast<double>(t.elapsed()) / report.num_kmers
+              << std::endl;
+}
+
+void perf_test_streaming_query(dictionary const& dict, uint64_t num_reads, uint64_t read_length,
+                               double error_rate, double negative_fraction) {
+    if (dict.canonicalized()) {
+        perf_test_streaming_query<streaming_query_canonical_parsing>(
+            dict, num_reads, read_length, error_rate, negative_fraction);
+    } else {
+        perf_test_streaming_query<streaming_query_regular_parsing>(
+            dict, num_reads, read_length, error_rate, negative_fraction);
+    }
+}
+
+#ifdef SSHASH_PERF_COUNTERS
+/*
+    Per-stage counters of the lookups of positive and negative k-mers: canonical lookups,
+    or regular lookups of the forward strand only and of both strands.
+*/
+void perf_test_lookup_stages(dictionary const& dict) {
+    constexpr uint64_t num_queries = 1000000;
+    essentials::uniform_int_rng<uint64_t> distr(0, dict.size() - 1, essentials::get_random_seed());
+    uint64_t k = dict.k();
+    std::string kmer(k, 0);
+    std::vector<kmer_t> positive_queries, negative_queries;
+    positive_queries.reserve(num_queries);
+    negative_queries.reserve(num_queries);
+    for (uint64_t i = 0; i != num_queries; ++i) {
+        dict.access(distr.gen(), kmer.data());
+        positive_queries.push_back(util::string_to_uint_kmer_no_reverse(kmer.data(), k));
+        random_kmer(kmer.data(), k);
+        negative_queries.push_back(util::string_to_uint_kmer_no_reverse(kmer.data(), k));
+    }
+    auto run = [&](std::vector<kmer_t> const& queries, bool check_reverse_complement,
+                   std::string const& name) {
+        perf::thread_counters().reset();
+        for (auto x : queries) {
+            auto res = dict.lookup_advanced_uint(x, check_reverse_complement);
+            essentials::do_not_optimize_away(res.kmer_id);
+        }
+        std::cout << name << " lookups: ";
+        perf::thread_counters().print(std::cout);
+    };
+    if (dict.canonicalized()) {
+        run(positive_queries, true, "positive canonical");
+        run(negative_queries, true, "negative canonical");
+        return;
+    }
+    run(positive_queries, false, "positive");
+    run(negative_queries, false, "negative");
+    run(positive_queries, true, "positive both-strands");
+    run(negative_queries, true, "negative both-strands");
+}
+#endif
+
+}  // namespace sshash
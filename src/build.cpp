@@ -31,20 +31,19 @@ int build(int argc, char** argv) {
                "-c", false);
     parser.add("output_filename", "Output file name where the data structure will be serialized.",
                "-o", false);
-    parser.add(
-        "tmp_dirname",
-        "Temporary directory used for construction in external memory. Default is directory '" +
-            constants::default_tmp_dirname + "'.",
-        "-d", false);
     parser.add("canonical_parsing",
                "Canonical parsing of k-mers. This option changes the parsing and results in a "
                "trade-off between index space and lookup time.",
                "--canonical-parsing", false, true);
     parser.add("weighted", "Also store the weights in compressed format.", "--weighted", false,
                true);
-    parser.add("check", "Check correctness after construction.", "--check", false, true);
+    add_construction_options(parser);
+    parser.add("check_num_threads",
+               "Check that the index does not depend on the number of threads, by building it "
+               "again with 1, 2 and 5 threads and with a tiny RAM budget (slow: it builds the "
+               "index up to five more times).",
+               "--check-num-threads", false, true);
     parser.add("bench", "Run benchmark after construction.", "--bench", false, true);
-    parser.add("verbose", "Verbose output during construction.", "--verbose", false, true);
 
     if (!parser.parse()) return 1;
 
@@ -63,11 +62,7 @@ int build(int argc, char** argv) {
     if (parser.parsed("c")) build_config.c = parser.get<double>("c");
     build_config.canonical_parsing = parser.get<bool>("canonical_parsing");
     build_config.weighted = parser.get<bool>("weighted");
-    build_config.verbose = parser.get<bool>("verbose");
-    if (parser.parsed("tmp_dirname")) {
-        build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
-        essentials::create_directory(build_config.tmp_dirname);
-    }
+    if (!parse_construction_options(parser, build_config)) return 1;
     build_config.print();
 
     dict.build(input_filename, build_config);
@@ -78,8 +73,14 @@ int build(int argc, char** argv) {
         check_correctness_lookup_access(dict, input_filename);
         check_correctness_navigational_kmer_query(dict, input_filename);
         check_correctness_navigational_contig_query(dict);
+        check_correctness_lookup_batch(dict);
         if (build_config.weighted) check_correctness_weights(dict, input_filename);
         check_correctness_iterator(dict);
+        check_correctness_streaming_query(dict, input_filename);
+        check_correctness_read_results(dict, input_filename);
+    }
+    if (parser.get<bool>("check_num_threads")) {
+        check_correctness_num_threads(dict, input_filename, build_config);
     }
     bool bench = parser.get<bool>("bench");
     if (bench) {
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "../include/gz/zip_stream.hpp"
+#include "../include/query/streaming_query.hpp"
+
+#include <cstring>
+#include <sstream>
 
 namespace sshash {
 
@@ -400,6 +404,217 @@ bool check_correctness_weights(dictionary const& dict, std::string const& filena
     return good;
 }
 
+/*
+    Check that querying a file with several threads gives the same report as the
+    sequential streaming query. In multiline mode, the parallel query re-starts its state
+    at every chunk, so only the number of (positive) k-mers must match.
+*/
+bool check_correctness_streaming_query(dictionary const& dict, std::string const& filename) {
+    std::cout << "checking correctness of parallel streaming query..." << std::endl;
+    for (bool multiline : {false, true}) {
+        auto expected = dict.streaming_query_from_file(filename, multiline, 1);
+        for (uint64_t num_threads : {2, 5}) {
+            auto got = dict.streaming_query_from_file(filename, multiline, num_threads);
+            if (got.num_kmers != expected.num_kmers or
+                got.num_positive_kmers != expected.num_positive_kmers or
+                (!multiline and (got.num_searches != expected.num_searches or
+                                 got.num_extensions != expected.num_extensions))) {
+                std::cout << "streaming query with " << num_threads << " threads"
+                          << (multiline ? " (multiline)" : "") << ": got " << got.num_kmers
+                          << " k-mers, " << got.num_positive_kmers << " positive, "
+                          << got.num_searches << " searches, " << got.num_extensions
+                          << " extensions but expected " << expected.num_kmers << ", "
+                          << expected.num_positive_kmers << ", " << expected.num_searches
+                          << ", " << expected.num_extensions << std::endl;
+                return false;
+            }
+        }
+    }
+    std::cout << "EVERYTHING OK!" << std::endl;
+    return true;
+}
+
+/*
+    Check the per-read output of the streaming query (binary format, sequential and
+    parallel) against lookup_advanced_uint on the k-mers of every record of filename.
+    The split of the hits by orientation is not compared: with regular parsing, both a
+    k-mer and its reverse complement may be in the dictionary.
+*/
+bool check_correctness_read_results(dictionary const& dict, std::string const& filename) {
+    std::cout << "checking correctness of the per-read output of streaming queries..."
+              << std::endl;
+    uint64_t k = dict.k();
+    bool gzipped = util::ends_with(filename, ".gz");
+    std::string name = gzipped ? filename.substr(0, filename.size() - 3) : filename;
+    bool fastq = util::ends_with(name, ".fq") or util::ends_with(name, ".fastq");
+    if (!fastq and !util::ends_with(name, ".fa") and !util::ends_with(name, ".fasta")) {
+        std::cout << "skipped: not a FASTA/FASTQ file name" << std::endl;
+        return true;
+    }
+
+    std::vector<read_result> expected;
+    std::ifstream is(filename.c_str());
+    if (!is.good()) throw std::runtime_error("error in opening the file '" + filename + "'");
+    auto lookup_records = [&](std::istream& input) {
+        fastx_reader reader(input, fastq);
+        while (reader.next()) {
+            read_result result;
+            std::string_view sequence = reader.sequence();
+            for (uint64_t i = 0; i + k <= sequence.size(); ++i) {
+                char const* kmer = sequence.data() + i;
+                if (!util::is_valid(kmer, k)) {
+                    result.add(lookup_result());
+                    continue;
+                }
+                kmer_t uint_kmer = util::string_to_uint_kmer_no_reverse(kmer, k);
+                result.add(dict.lookup_advanced_uint(uint_kmer));
+            }
+            auto& ids = result.contig_ids;
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            expected.push_back(std::move(result));
+        }
+    };
+    if (gzipped) {
+        zip_istream zis(is);
+        lookup_records(zis);
+    } else {
+        lookup_records(is);
+    }
+    is.close();
+
+    for (uint64_t num_threads : {1, 3}) {
+        std::ostringstream out;
+        dict.streaming_query_from_file(filename, false, num_threads, &out, true);
+        std::string const output = out.str();
+        uint64_t pos = 0;
+        for (uint64_t i = 0; i != expected.size(); ++i) {
+            read_result const& e = expected[i];
+            uint32_t header[6];
+            if (pos + sizeof(header) > output.size()) {
+                std::cout << "output with " << num_threads << " threads: missing read " << i
+                          << std::endl;
+                return false;
+            }
+            std::memcpy(header, output.data() + pos, sizeof(header));
+            pos += sizeof(header);
+            std::vector<uint64_t> contig_ids(header[5]);
+            if (pos + contig_ids.size() * sizeof(uint64_t) > output.size()) {
+                std::cout << "output with " << num_threads << " threads: truncated read " << i
+                          << std::endl;
+                return false;
+            }
+            std::memcpy(contig_ids.data(), output.data() + pos,
+                        contig_ids.size() * sizeof(uint64_t));
+            pos += contig_ids.size() * sizeof(uint64_t);
+            if (header[0] != e.num_kmers or
+                header[1] + header[2] != e.num_forward_hits + e.num_backward_hits or
+                header[3] != e.first_hit or header[4] != e.last_hit or
+                contig_ids != e.contig_ids) {
+                std::cout << "output with " << num_threads << " threads: read " << i << " has "
+                          << header[0] << " k-mers, " << header[1] + header[2]
+                          << " hits in [" << header[3] << "," << header[4] << "] but expected "
+                          << e.num_kmers << " k-mers, "
+                          << e.num_forward_hits + e.num_backward_hits << " hits in ["
+                          << e.first_hit << "," << e.last_hit << "]" << std::endl;
+                return false;
+            }
+        }
+        if (pos != output.size()) {
+            std::cout << "output with " << num_threads << " threads: "
+                      << output.size() - pos << " bytes past the last read" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "checked " << expected.size() << " reads" << std::endl;
+    std::cout << "EVERYTHING OK!" << std::endl;
+    return true;
+}
+
+/* A visitor that serializes a data structure into memory, in the format of essentials::save. */
+struct bytes_saver {
+    template <typename T>
+    void visit(T& val) {
+        if constexpr (is_pod<T>()) {
+            append(&val, sizeof(T));
+        } else {
+            val.visit(*this);
+        }
+    }
+
+    template <typename T, typename Allocator>
+    void visit(std::vector<T, Allocator>& vec) {
+        size_t n = vec.size();
+        visit(n);
+        if constexpr (is_pod<T>()) {
+            append(vec.data(), n * sizeof(T));
+        } else {
+            for (auto& v : vec) visit(v);
+        }
+    }
+
+    std::string bytes;
+
+private:
+    template <typename T>
+    static constexpr bool is_pod() {
+        return std::is_trivial<T>::value and std::is_standard_layout<T>::value;
+    }
+
+    void append(void const* data, uint64_t num_bytes) {
+        bytes.append(static_cast<char const*>(data), num_bytes);
+    }
+};
+
+/*
+    Check that the construction does not depend on the number of threads: the index
+    built from filename with build_config must serialize to the same bytes as dict,
+    which was built from the same file with a different number of threads.
+*/
+bool check_same_index(dictionary& dict, std::string const& filename,
+                      build_configuration const& build_config) {
+    dictionary other;
+    other.build(filename, build_config);
+    bytes_saver expected;
+    bytes_saver got;
+    expected.visit(dict);
+    got.visit(other);
+    if (got.bytes != expected.bytes) {
+        std::cout << "the index built with " << build_config.num_threads
+                  << " threads differs from the original one (" << got.bytes.size() << " vs. "
+                  << expected.bytes.size() << " bytes)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+   The input file must be the one dict was built from, with build_config.
+*/
+bool check_correctness_num_threads(dictionary& dict, std::string const& filename,
+                                   build_configuration build_config) {
+    std::cout << "checking that the index does not depend on the number of threads..."
+              << std::endl;
+    build_config.verbose = false;
+    uint64_t num_threads_of_dict = build_config.num_threads;
+    for (uint64_t num_threads : {1, 2, 5}) {
+        if (num_threads == num_threads_of_dict) continue;
+        build_config.num_threads = num_threads;
+        if (!check_same_index(dict, filename, build_config)) return false;
+    }
+    /*
+        With about 1 byte of RAM per k-mer, the minimizer tuples are sorted into several
+        runs (in background, with more threads) and merged from disk.
+    */
+    build_config.ram = std::max<uint64_t>(dict.size(), 4096);
+    for (uint64_t num_threads : {1, 3}) {
+        build_config.num_threads = num_threads;
+        if (!check_same_index(dict, filename, build_config)) return false;
+    }
+    std::cout << "EVERYTHING OK!" << std::endl;
+    return true;
+}
+
 bool check_dictionary(dictionary const& dict) {
     uint64_t k = dict.k();
     uint64_t n = dict.size();
@@ -428,6 +643,39 @@ bool check_dictionary(dictionary const& dict) {
     return true;
 }
 
+bool check_correctness_lookup_batch(dictionary const& dict) {
+    std::cout << "checking correctness of batched lookup..." << std::endl;
+    constexpr uint64_t num_queries = 1000000;
+    uint64_t k = dict.k();
+    std::string kmer(k, 0);
+    essentials::uniform_int_rng<uint64_t> distr(0, dict.size() - 1, essentials::get_random_seed());
+    std::vector<kmer_t> queries;
+    queries.reserve(num_queries);
+    for (uint64_t i = 0; i != num_queries; ++i) {
+        if (i % 3 == 0) {
+            /* also include some (likely) negative kmers */
+            random_kmer(kmer.data(), k);
+        } else {
+            dict.access(distr.gen(), kmer.data());
+        }
+        kmer_t uint_kmer = util::string_to_uint_kmer_no_reverse(kmer.data(), k);
+        if ((i & 1) == 0) uint_kmer = util::compute_reverse_complement(uint_kmer, k);
+        queries.push_back(uint_kmer);
+    }
+    std::vector<lookup_result> results(queries.size());
+    dict.lookup_batch(queries.data(), queries.size(), results.data());
+    for (uint64_t i = 0; i != queries.size(); ++i) {
+        auto expected = dict.lookup_advanced_uint(queries[i]);
+        if (!equal_lookup_result(expected, results[i])) {
+            std::cout << "ERROR: batched lookup differs for kmer '"
+                      << util::uint_kmer_to_string_no_reverse(queries[i], k) << "'" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "EVERYTHING OK!" << std::endl;
+    return true;
+}
+
 bool check_correctness_iterator(dictionary const& dict) {
     std::cout << "checking correctness of iterator..." << std::endl;
     std::string expected_kmer(dict.k(), 0);
@@ -449,9 +697,152 @@ bool check_correctness_iterator(dictionary const& dict) {
             ++from_kmer_id;
         }
         assert(from_kmer_id == dict.size());
+
+        from_kmer_id = distr.gen();
+        auto uint_it = dict.at_uint(from_kmer_id);
+        while (uint_it.has_next()) {
+            auto [kmer_id, uint_kmer] = uint_it.next();
+            dict.access(kmer_id, expected_kmer.data());
+            if (uint_kmer != util::string_to_uint_kmer_no_reverse(expected_kmer.data(), dict.k()) or
+                kmer_id != from_kmer_id) {
+                std::cout << "uint_iterator: got kmer_id " << kmer_id << " but expected ("
+                          << from_kmer_id << ",'" << expected_kmer << "')" << std::endl;
+                return false;
+            }
+            ++from_kmer_id;
+        }
+        assert(from_kmer_id == dict.size());
+    }
+
+    uint64_t expected_kmer_id = 0;
+    bool good = true;
+    dict.for_each_kmer([&](uint64_t kmer_id, kmer_t uint_kmer) {
+        if (!good) return;
+        dict.access(expected_kmer_id, expected_kmer.data());
+        if (uint_kmer != util::string_to_uint_kmer_no_reverse(expected_kmer.data(), dict.k()) or
+            kmer_id != expected_kmer_id) {
+            std::cout << "for_each_kmer: got kmer_id " << kmer_id << " but expected ("
+                      << expected_kmer_id << ",'" << expected_kmer << "')" << std::endl;
+            good = false;
+        }
+        ++expected_kmer_id;
+    });
+    if (!good) return false;
+    assert(expected_kmer_id == dict.size());
+
+    for (uint64_t num_threads : {2, 7}) {
+        std::vector<uint8_t> seen(dict.size(), 0);  // written by a single thread each
+        std::atomic<bool> parallel_good(true);
+        dict.parallel_for_each_kmer(num_threads, [&](uint64_t kmer_id, kmer_t uint_kmer) {
+            std::string kmer(dict.k(), 0);
+            dict.access(kmer_id, kmer.data());
+            if (uint_kmer != util::string_to_uint_kmer_no_reverse(kmer.data(), dict.k())) {
+                parallel_good = false;
+            }
+            seen[kmer_id] += 1;
+        });
+        bool once = std::all_of(seen.begin(), seen.end(), [](uint8_t x) { return x == 1; });
+        if (!parallel_good or !once) {
+            std::cout << "parallel_for_each_kmer with " << num_threads
+                      << " threads: wrong or missing k-mers" << std::endl;
+            return false;
+        }
+    }
+
+    expected_kmer_id = 0;
+    auto contig_it = dict.begin_contigs();
+    for (uint64_t contig_id = 0; contig_it.has_next(); ++contig_id) {
+        auto span = contig_it.next();
+        if (span.contig_id != contig_id or span.kmer_id != expected_kmer_id or
+            span.end - span.begin != dict.contig_size(contig_id) + dict.k() - 1) {
+            std::cout << "contig_iterator: wrong span for contig " << contig_id << std::endl;
+            return false;
+        }
+        expected_kmer_id += dict.contig_size(contig_id);
+    }
+    assert(expected_kmer_id == dict.size());
+
+    std::cout << "EVERYTHING OK!" << std::endl;
+    return true;
+}
+
+/*
+    Check that the union of a and b keeps the ids (and weights) of the k-mers of a
+    and contains every k-mer of b. With regular parsing, a k-mer and its reverse
+    complement are distinct k-mers, hence the strands are not mixed by the lookups.
+*/
+bool check_correctness_merge(dictionary const& dict, dictionary const& a, dictionary const& b) {
+    std::cout << "checking correctness of merge..." << std::endl;
+    bool good = true;
+    a.for_each_kmer([&](uint64_t kmer_id, kmer_t uint_kmer) {
+        if (!good) return;
+        auto res = dict.lookup_advanced_uint(uint_kmer, false);
+        if (res.kmer_id != kmer_id or
+            (a.weighted() and dict.weight(res.kmer_id) != a.weight(kmer_id))) {
+            std::cout << "k-mer " << kmer_id << " of the first dictionary got id " << res.kmer_id
+                      << std::endl;
+            good = false;
+        }
+    });
+    if (!good) return false;
+    uint64_t num_kmers_only_in_b = 0;
+    b.for_each_kmer([&](uint64_t kmer_id, kmer_t uint_kmer) {
+        if (!good) return;
+        auto res = dict.lookup_advanced_uint(uint_kmer, false);
+        if (res.kmer_id == constants::invalid_uint64) {
+            std::cout << "k-mer " << kmer_id << " of the second dictionary not found" << std::endl;
+            good = false;
+        }
+        num_kmers_only_in_b += res.kmer_id >= a.size();
+    });
+    if (!good) return false;
+    if (dict.size() != a.size() + num_kmers_only_in_b) {
+        std::cout << "expected " << a.size() + num_kmers_only_in_b << " k-mers but got "
+                  << dict.size() << std::endl;
+        return false;
     }
     std::cout << "EVERYTHING OK!" << std::endl;
     return true;
 }
 
+/*
+    Merge two small dictionaries built with regular parsing from random sequences, where
+    the second one contains the reverse complements of some k-mers of the first one.
+    These k-mers are not in the first dictionary, hence the union must keep them.
+*/
+bool check_correctness_merge_reverse_complements(build_configuration build_config) {
+    std::cout << "checking merge of reverse complements with regular parsing..." << std::endl;
+    uint64_t k = build_config.k;
+    std::string a_sequence(1000 + k - 1, 0);
+    random_kmer(a_sequence.data(), a_sequence.size());
+    std::string b_sequence(300 + k - 1, 0);
+    util::compute_reverse_complement(a_sequence.data() + 100, b_sequence.data(),
+                                     b_sequence.size());
+    std::string other_sequence(500 + k - 1, 0);
+    random_kmer(other_sequence.data(), other_sequence.size());
+
+    std::string a_filename = build_config.tmp_dirname + "/sshash.tmp.merge_check.a.fa";
+    std::string b_filename = build_config.tmp_dirname + "/sshash.tmp.merge_check.b.fa";
+    {
+        std::ofstream a_out(a_filename.c_str());
+        std::ofstream b_out(b_filename.c_str());
+        if (!a_out.good() or !b_out.good()) {
+            throw std::runtime_error("cannot write the temporary files of the merge check");
+        }
+        a_out << ">a\n" << a_sequence << '\n';
+        b_out << ">b\n" << b_sequence << "\n>c\n" << other_sequence << '\n';
+    }
+
+    build_config.canonical_parsing = false;
+    build_config.weighted = false;
+    build_config.verbose = false;
+    dictionary a, b, dict;
+    a.build(a_filename, build_config);
+    b.build(b_filename, build_config);
+    std::remove(a_filename.c_str());
+    std::remove(b_filename.c_str());
+    dict.merge(a, b, build_config);
+    return check_correctness_merge(dict, a, b);
+}
+
 }  // namespace sshash
\ No newline at end of file
@@ -2,17 +2,115 @@
 
 #include "../external/pthash/external/cmd_line_parser/include/parser.hpp"
 #include "../include/dictionary.hpp"
+#include "../include/huge_pages.hpp"
 
+#include <new>
 #include <vector>
 
+/* see sshash::huge_page_allocations */
+void* operator new(std::size_t num_bytes) {
+    void* ptr = sshash::huge_pages_allocate(num_bytes);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+void* operator new[](std::size_t num_bytes) { return ::operator new(num_bytes); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
 namespace sshash {
 
 void random_kmer(char* kmer, uint64_t k) {
     for (uint64_t i = 0; i != k; ++i) kmer[i] = "ACGT"[rand() % 4];
 }
 
-void load_dictionary(dictionary& dict, std::string const& index_filename, bool verbose) {
-    uint64_t num_bytes_read = essentials::load(dict, index_filename.c_str());
+/* Back the index with transparent huge pages and report how much of it is. */
+void back_with_huge_pages(dictionary& dict) {
+    auto advisor = use_huge_pages(dict);
+    std::cout << "huge pages: " << essentials::convert(advisor.advised_bytes(), essentials::MB)
+              << " [MB] advised, " << essentials::convert(advisor.collapsed_bytes(), essentials::MB)
+              << " [MB] collapsed, " << essentials::convert(anon_huge_pages_bytes(), essentials::MB)
+              << " [MB] in use by the process" << std::endl;
+}
+
+/* Add the construction options shared by the tools 'build' and 'merge'. */
+void add_construction_options(cmd_line_parser::parser& parser) {
+    parser.add(
+        "tmp_dirname",
+        "Temporary directory used for construction in external memory. Default is directory '" +
+            constants::default_tmp_dirname + "'.",
+        "-d", false);
+    parser.add("ram",
+               "RAM budget (in GB) for construction; temporary files are only used beyond it "
+               "(default is " +
+                   std::to_string(constants::default_ram / essentials::GB) + ").",
+               "--ram", false);
+    parser.add("filter_bits_per_kmer",
+               "Bits per k-mer of a Bloom filter consulted before the buckets, to speed up "
+               "negative lookups (default is 0, i.e., no filter).",
+               "--filter-bits", false);
+    parser.add("locality_layout",
+               "Store the offsets of each bucket next to its size (and the offset of a singleton "
+               "bucket in place of its size) to save cache misses per lookup, at a small space "
+               "cost.",
+               "--locality-layout", false, true);
+    parser.add("singleton_split",
+               "Mark the singleton buckets in a bit vector and store their offsets first, so that "
+               "a lookup in a singleton bucket needs a rank instead of two Elias-Fano accesses "
+               "(not compatible with --locality-layout).",
+               "--singleton-split", false, true);
+    parser.add("num_threads", "Number of threads used for construction (default is 1).", "-t",
+               false);
+    parser.add("check", "Check correctness after construction.", "--check", false, true);
+    parser.add("verbose", "Verbose output during construction.", "--verbose", false, true);
+}
+
+/* Fill build_config with the options added by add_construction_options.
+   Return false, after printing the error, if they are not valid. */
+bool parse_construction_options(cmd_line_parser::parser const& parser,
+                                build_configuration& build_config) {
+    build_config.verbose = parser.get<bool>("verbose");
+    build_config.locality_layout = parser.get<bool>("locality_layout");
+    build_config.singleton_split = parser.get<bool>("singleton_split");
+    if (build_config.locality_layout and build_config.singleton_split) {
+        std::cerr << "--locality-layout and --singleton-split cannot be used together"
+                  << std::endl;
+        return false;
+    }
+    if (parser.parsed("ram")) {
+        double ram = parser.get<double>("ram");
+        if (ram <= 0) {
+            std::cerr << "RAM budget must be > 0" << std::endl;
+            return false;
+        }
+        build_config.ram = static_cast<uint64_t>(ram * essentials::GB);
+    }
+    if (parser.parsed("filter_bits_per_kmer")) {
+        build_config.filter_bits_per_kmer = parser.get<uint64_t>("filter_bits_per_kmer");
+    }
+    if (parser.parsed("num_threads")) {
+        build_config.num_threads = parser.get<uint64_t>("num_threads");
+        if (build_config.num_threads == 0) {
+            std::cerr << "number of threads must be > 0" << std::endl;
+            return false;
+        }
+    }
+    if (parser.parsed("tmp_dirname")) {
+        build_config.tmp_dirname = parser.get<std::string>("tmp_dirname");
+        essentials::create_directory(build_config.tmp_dirname);
+    }
+    return true;
+}
+
+void load_dictionary(dictionary& dict, std::string const& index_filename, bool verbose,
+                     bool huge_pages = false) {
+    uint64_t num_bytes_read = 0;
+    {
+        huge_page_allocations_scope scope(huge_pages);
+        num_bytes_read = essentials::load(dict, index_filename.c_str());
+    }
+    if (huge_pages) back_with_huge_pages(dict);
     if (verbose) {
         std::cout << "index size: " << essentials::convert(num_bytes_read, essentials::MB)
                   << " [MB] (" << (num_bytes_read * 8.0) / dict.size() << " [bits/kmer])"
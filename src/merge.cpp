@@ -0,0 +1,89 @@
+using namespace sshash;
+
+int merge(int argc, char** argv) {
+    cmd_line_parser::parser parser(argc, argv);
+
+    /* Required arguments. */
+    parser.add("index_filename_a", "Must be a file generated with the tool 'build'.", "-a",
+               true);
+    parser.add("index_filename_b",
+               "Must be a file generated with the tool 'build', with the same k, m, seed and "
+               "parsing as the first one.",
+               "-b", true);
+    parser.add("output_filename", "Output file name where the merged index will be serialized.",
+               "-o", true);
+
+    /* Optional arguments. */
+    parser.add("l",
+               "A (integer) constant that controls the space/time trade-off of the dictionary "
+               "(default is the one of the input dictionaries, which must agree).",
+               "-l", false);
+    parser.add("c",
+               "A (floating point) constant that trades construction speed for space effectiveness "
+               "of minimal perfect hashing "
+               "(default is the one of the input dictionaries, which must agree).",
+               "-c", false);
+    add_construction_options(parser);
+    parser.add("check_reverse_complements",
+               "Build and merge two small dictionaries from random sequences (independently of "
+               "the input dictionaries, in the temporary directory), where the second one holds "
+               "the reverse complements of k-mers of the first one, and check that the union "
+               "keeps them.",
+               "--check-reverse-complements", false, true);
+
+    if (!parser.parse()) return 1;
+
+    build_configuration build_config;
+    if (!parse_construction_options(parser, build_config)) return 1;
+
+    dictionary a, b;
+    load_dictionary(a, parser.get<std::string>("index_filename_a"), build_config.verbose);
+    load_dictionary(b, parser.get<std::string>("index_filename_b"), build_config.verbose);
+
+    build_config.k = a.k();
+    build_config.m = a.m();
+    build_config.seed = a.seed();
+    build_config.canonical_parsing = a.canonicalized();
+    build_config.weighted = a.weighted();
+
+    if (parser.parsed("l")) {
+        build_config.l = parser.get<double>("l");
+    } else if (a.l() != b.l()) {
+        std::cerr << "the dictionaries were built with l = " << a.l() << " and l = " << b.l()
+                  << ": choose one with -l" << std::endl;
+        return 1;
+    } else {
+        build_config.l = a.l();
+    }
+    if (parser.parsed("c")) {
+        build_config.c = parser.get<double>("c");
+    } else if (a.c() != b.c()) {
+        std::cerr << "the dictionaries were built with c = " << a.c() << " and c = " << b.c()
+                  << ": choose one with -c" << std::endl;
+        return 1;
+    } else {
+        build_config.c = a.c();
+    }
+    build_config.print();
+
+    dictionary dict;
+    dict.merge(a, b, build_config);
+
+    bool check = parser.get<bool>("check");
+    if (check) {
+        check_dictionary(dict);
+        check_correctness_merge(dict, a, b);
+        check_correctness_navigational_contig_query(dict);
+        check_correctness_iterator(dict);
+    }
+    if (parser.get<bool>("check_reverse_complements")) {
+        check_correctness_merge_reverse_complements(build_config);
+    }
+
+    auto output_filename = parser.get<std::string>("output_filename");
+    essentials::logger("saving data structure to disk...");
+    essentials::save(dict, output_filename.c_str());
+    essentials::logger("DONE");
+
+    return 0;
+}
@@ -14,6 +14,19 @@ int query(int argc, char** argv) {
                "Use this option if more the one DNA line must be parsed after each header."
                " Only valid for FASTA files (not FASTQ).",
                "--multiline", false, true);
+    parser.add("num_threads",
+               "Number of threads used to query the file (default is 1). "
+               "A further thread is used to read the file.",
+               "-t", false);
+    parser.add("output_filename",
+               "Write a summary of every read (hits, first/last hit positions, contigs hit) "
+               "to this file, in input order. The format is TSV unless --binary is given. "
+               "Not available with --multiline.",
+               "-o", false);
+    parser.add("binary", "Write the per-read summaries of -o in binary format.", "--binary",
+               false, true);
+    parser.add("huge_pages", "Back the loaded index with transparent huge pages.",
+               "--huge-pages", false, true);
     parser.add("verbose", "Verbose output.", "--verbose", false, true);
     if (!parser.parse()) return 1;
 
@@ -21,14 +34,35 @@ int query(int argc, char** argv) {
     auto query_filename = parser.get<std::string>("query_filename");
     bool verbose = parser.get<bool>("verbose");
     bool multiline = parser.get<bool>("multiline");
+    bool huge_pages = parser.get<bool>("huge_pages");
+    uint64_t num_threads = 1;
+    if (parser.parsed("num_threads")) num_threads = parser.get<uint64_t>("num_threads");
+    if (num_threads == 0) {
+        std::cerr << "number of threads must be > 0" << std::endl;
+        return 1;
+    }
 
     dictionary dict;
-    load_dictionary(dict, index_filename, verbose);
+    load_dictionary(dict, index_filename, verbose, huge_pages);
 
     essentials::logger("performing queries from file '" + query_filename + "'...");
     essentials::timer<std::chrono::high_resolution_clock, std::chrono::microseconds> t;
     t.start();
-    auto report = dict.streaming_query_from_file(query_filename, multiline);
+    streaming_query_report report;
+    if (parser.parsed("output_filename")) {
+        auto output_filename = parser.get<std::string>("output_filename");
+        bool binary = parser.get<bool>("binary");
+        std::ofstream out(output_filename.c_str(),
+                          binary ? std::ios::out | std::ios::binary : std::ios::out);
+        if (!out.good()) {
+            throw std::runtime_error("error in opening the file '" + output_filename + "'");
+        }
+        report = dict.streaming_query_from_file(query_filename, multiline, num_threads, &out,
+                                                binary);
+        out.close();
+    } else {
+        report = dict.streaming_query_from_file(query_filename, multiline, num_threads);
+    }
     t.stop();
     essentials::logger("DONE");
 
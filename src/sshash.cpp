@@ -6,6 +6,7 @@
 #include "build.cpp"
 #include "query.cpp"
 #include "permute.cpp"
+#include "merge.cpp"
 
 using namespace sshash;
 
@@ -20,21 +21,65 @@ int check(int argc, char** argv) {
     load_dictionary(dict, index_filename, verbose);
     check_dictionary(dict);
     check_correctness_navigational_contig_query(dict);
+    check_correctness_lookup_batch(dict);
     return 0;
 }
 
 int bench(int argc, char** argv) {
     cmd_line_parser::parser parser(argc, argv);
     parser.add("index_filename", "Must be a file generated with the tool 'build'.", "-i", true);
+    parser.add("huge_pages",
+               "Run the lookups with and without transparent huge pages. The other "
+               "benchmarks use huge pages.",
+               "--huge-pages", false, true);
+    parser.add("num_reads",
+               "Number of reads synthesized for the streaming query test (default is 100000).",
+               "--num-reads", false);
+    parser.add("read_length", "Length of the synthesized reads (default is 150).",
+               "--read-length", false);
+    parser.add("error_rate",
+               "Probability that a base of a synthesized read is substituted (default is 0.01).",
+               "--error-rate", false);
+    parser.add("negative_fraction",
+               "Fraction of the synthesized reads made of random bases (default is 0.1).",
+               "--negative-fraction", false);
+    parser.add("latency_json",
+               "Write the histograms of the lookup latencies to this file, in JSON format.",
+               "--latency-json", false);
     parser.add("verbose", "Verbose output.", "--verbose", false, true);
     if (!parser.parse()) return 1;
     auto index_filename = parser.get<std::string>("index_filename");
     bool verbose = parser.get<bool>("verbose");
+    bool huge_pages = parser.get<bool>("huge_pages");
+    uint64_t num_reads = 100000;
+    uint64_t read_length = 150;
+    double error_rate = 0.01;
+    double negative_fraction = 0.1;
+    if (parser.parsed("num_reads")) num_reads = parser.get<uint64_t>("num_reads");
+    if (parser.parsed("read_length")) read_length = parser.get<uint64_t>("read_length");
+    if (parser.parsed("error_rate")) error_rate = parser.get<double>("error_rate");
+    if (parser.parsed("negative_fraction")) {
+        negative_fraction = parser.get<double>("negative_fraction");
+    }
+    if (huge_pages) {
+        dictionary dict;
+        load_dictionary(dict, index_filename, verbose);
+        std::cout << "==== without huge pages" << std::endl;
+        perf_test_lookup_access(dict);
+        std::cout << "==== with huge pages" << std::endl;
+    }
     dictionary dict;
-    load_dictionary(dict, index_filename, verbose);
+    load_dictionary(dict, index_filename, verbose, huge_pages);
     perf_test_lookup_access(dict);
+    std::string latency_json;
+    if (parser.parsed("latency_json")) latency_json = parser.get<std::string>("latency_json");
+    perf_test_lookup_latency(dict, latency_json);
     if (dict.weighted()) perf_test_lookup_weight(dict);
     perf_test_iterator(dict);
+#ifdef SSHASH_PERF_COUNTERS
+    perf_test_lookup_stages(dict);
+#endif
+    perf_test_streaming_query(dict, num_reads, read_length, error_rate, negative_fraction);
     return 0;
 }
 
@@ -77,6 +122,7 @@ int help(char* arg0) {
               << "  check              \t check correctness of a dictionary \n"
               << "  bench              \t run performance tests for a dictionary \n"
               << "  dump               \t write super-k-mers of a dictionary to a fasta file \n"
+              << "  merge              \t build the union of two dictionaries \n"
               << "  permute            \t permute a weighted input file \n"
               << "  compute-statistics \t compute index statistics " << std::endl;
     return 1;
@@ -95,6 +141,8 @@ int main(int argc, char** argv) {
         return bench(argc - 1, argv + 1);
     } else if (tool == "dump") {
         return dump(argc - 1, argv + 1);
+    } else if (tool == "merge") {
+        return merge(argc - 1, argv + 1);
     } else if (tool == "permute") {
         return permute(argc - 1, argv + 1);
     } else if (tool == "compute-statistics") {